@@ -5,11 +5,14 @@
  * @author Narukara
  * @date 2021.2
  */
+#include "NAR_BUS.h"
 #include "NAR_GPIO.h"
 #include "NAR_I2C.h"
 #include "algorithm.h"
+#include "packed.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "string.h"
@@ -208,6 +211,7 @@ void MAX30102_shutdown(uint8_t on_off, uint8_t which) {
 
 /**
  * @param[out] ir_led ir led data read from fifo
+ * @param[out] red_led Nullable, red led data read from fifo
  *
  * @param[in] which
  * | 0 - hr
@@ -215,7 +219,9 @@ void MAX30102_shutdown(uint8_t on_off, uint8_t which) {
  *
  * @return ESP_OK if successful
  */
-static esp_err_t MAX30102_read_fifo(uint32_t* ir_led, uint8_t which) {
+static esp_err_t MAX30102_read_fifo(uint32_t* ir_led,
+                                    uint32_t* red_led,
+                                    uint8_t which) {
     if (status != running) {
         return ESP_FAIL;
     }
@@ -264,11 +270,19 @@ static esp_err_t MAX30102_read_fifo(uint32_t* ir_led, uint8_t which) {
     temp = read_buffer[5];
     *ir_led += temp;
     *ir_led &= 0x03FFFF;
+    if (red_led) {
+        *red_led = (((uint32_t)read_buffer[0] << 16) | (read_buffer[1] << 8) |
+                    read_buffer[2]) &
+                   0x03FFFF;
+    }
     return ESP_OK;
 }
 
 #define THRESHOLD 90000
 
+// streaming owns the hr sensor, see MAX30102_stream
+static TaskHandle_t stream_task = NULL;
+
 /**
  * @brief detect whether there is something nearby
  * | that is to say, whether the band is wearing
@@ -279,10 +293,16 @@ uint8_t MAX30102_on() {
     if (status != running) {
         return 0;
     }
+    if (stream_task) {
+        // the sensor is running already, judge from the latest sample
+        NAR_BUS_sample_t sample;
+        return NAR_BUS_nearest(NAR_BUS_PPG, esp_timer_get_time(), &sample) &&
+               sample.value[0] > THRESHOLD;
+    }
     MAX30102_shutdown(1, 1);
     vTaskDelay(500 / portTICK_PERIOD_MS);
     uint32_t ir;
-    if (MAX30102_read_fifo(&ir, 1) == ESP_OK) {
+    if (MAX30102_read_fifo(&ir, NULL, 1) == ESP_OK) {
         MAX30102_shutdown(0, 1);
         // ESP_LOGI(TAG, "%u", ir);
         return (ir > THRESHOLD);
@@ -318,64 +338,642 @@ double MAX30102_get_temp() {
 }
 
 #define BUFFER_LENGTH (500)
-static uint32_t ir_buffer[BUFFER_LENGTH];
+// 18-bit samples, packed to 3 bytes and filtered in place by algorithm.c
+static uint8_t ir_buffer[PACKED_SIZE(BUFFER_LENGTH)];
+// accelerometer reference for motion cancellation, at the scale the no
+// motion threshold NLMS_MIN_VAR in algorithm.c was tuned for
+#define REF_LSB_PER_G (64)
+static int8_t accel_buffer[BUFFER_LENGTH][3];
+// max distance between a ppg sample and its accelerometer sample
+#define MAX_SKEW_US (20000)
+#define INTR_TIMEOUT_MS (100)
+
+/**
+ * @brief wait for the next sample of hr sensor, read it and publish it to
+ * NAR_BUS
+ * @param[out] time Nullable, INT edge of the sample, us
+ * @return ESP_OK
+ * | ESP_ERR_TIMEOUT - no INT in time, only the running capture is lost
+ * | ESP_FAIL - I2C failed, fused
+ */
+static esp_err_t MAX30102_next_sample(uint32_t* ir_led, int64_t* time) {
+    int64_t now;
+    if (!NAR_GPIO_wait_MAX30102_intr(INTR_TIMEOUT_MS, &now)) {
+        ESP_LOGW(TAG, "no INT in %d ms", INTR_TIMEOUT_MS);
+        return ESP_ERR_TIMEOUT;
+    }
+    uint32_t red;
+    if (MAX30102_read_fifo(ir_led, &red, 0) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    NAR_BUS_push(NAR_BUS_PPG, now, (int32_t[]){*ir_led, red, 0});
+    if (time) {
+        *time = now;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @return right shift from raw accelerometer values to REF_LSB_PER_G, as
+ * the accelerometer full scale range sets it
+ * | -1 - unknown
+ */
+static int8_t MAX30102_accel_shift() {
+    int32_t sens = NAR_BUS_get_scale(NAR_BUS_ACCEL);
+    if (sens <= 0) {
+        return -1;
+    }
+    // rounds up, inv_mpu reports 8092 LSB/g at 4 g
+    int8_t shift = 0;
+    while ((REF_LSB_PER_G << shift) < sens) {
+        shift++;
+    }
+    return shift;
+}
+
+/**
+ * @brief fetch the accelerometer sample aligned to a ppg sample
+ * | zero if there is none close enough, or its scale is unknown
+ */
+static void MAX30102_accel_ref(int64_t time, int8_t ref[3]) {
+    NAR_BUS_sample_t sample;
+    int8_t shift = MAX30102_accel_shift();
+    if (shift >= 0 && NAR_BUS_nearest(NAR_BUS_ACCEL, time, &sample) &&
+        sample.time > time - MAX_SKEW_US && sample.time < time + MAX_SKEW_US) {
+        for (uint8_t a = 0; a < 3; a++) {
+            int32_t v = sample.value[a] >> shift;
+            ref[a] = v > INT8_MAX ? INT8_MAX : (v < INT8_MIN ? INT8_MIN : v);
+        }
+    } else {
+        ref[0] = ref[1] = ref[2] = 0;
+    }
+}
+
+// LED current, 1 LSB == 0.2 mA
+#define PA_DEFAULT (0x24)
+#define PA_MIN (0x04)
+#define PA_MAX (0xFF)
+// IR DC level target band, full scale is 0x3FFFF
+#define DC_LOW (80000)
+#define DC_TARGET (120000)
+#define DC_HIGH (180000)
+#define AGC_ROUNDS (3)
+#define AGC_SKIP (2)
+#define AGC_SAMPLES (12)
+
+static uint8_t led_pa = PA_DEFAULT;
+static uint32_t led_pa_sum = 0;
+static uint32_t led_pa_count = 0;
+static uint16_t led_current = 0;
+
+/**
+ * @brief set LED1 (red) and LED2 (ir) current of hr sensor
+ */
+static esp_err_t MAX30102_set_pa(uint8_t pa) {
+    if (i2c_write_check(MAX30102, LED1_PA, 2, (uint8_t[]){pa, pa}) !=
+        ESP_OK) {
+        fuse();
+        return ESP_FAIL;
+    }
+    led_pa = pa;
+    return ESP_OK;
+}
+
+/**
+ * @brief scale LED current so that the IR DC level moves to DC_TARGET
+ * @param[in] mean IR DC level measured with current led_pa
+ * @return 1 if led_pa is changed
+ */
+static uint8_t MAX30102_agc_update(uint32_t mean) {
+    if (mean >= DC_LOW && mean <= DC_HIGH) {
+        return 0;
+    }
+    uint32_t pa = mean ? (uint32_t)led_pa * DC_TARGET / mean : PA_MAX;
+    if (pa > PA_MAX) {
+        pa = PA_MAX;
+    } else if (pa < PA_MIN) {
+        pa = PA_MIN;
+    }
+    if (pa == led_pa) {
+        return 0;
+    }
+    return MAX30102_set_pa(pa) == ESP_OK;
+}
+
+/**
+ * @brief closed-loop LED current settling before a measurement.
+ * | at most AGC_ROUNDS * (AGC_SKIP + AGC_SAMPLES) samples, i.e. 420 ms
+ * @return ESP_OK if successful
+ */
+static esp_err_t MAX30102_agc() {
+    if (MAX30102_set_pa(led_pa) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    for (uint8_t round = 0; round < AGC_ROUNDS; round++) {
+        uint32_t ir, sum = 0;
+        // samples right after a current change are not settled
+        for (uint8_t i = 0; i < AGC_SKIP + AGC_SAMPLES; i++) {
+            if (MAX30102_next_sample(&ir, NULL) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            if (i >= AGC_SKIP) {
+                sum += ir;
+            }
+        }
+        if (!MAX30102_agc_update(sum / AGC_SAMPLES)) {
+            break;
+        }
+    }
+    ESP_LOGI(TAG, "agc pa 0x%02x", led_pa);
+    return ESP_OK;
+}
+
+/**
+ * @return average LED current of the last hr measurement, in 0.1 mA
+ */
+uint16_t MAX30102_get_led_current() {
+    return led_current;
+}
+
 #define MAX_HR (200)
 #define MAX_DIFF (25)
+#define MAX_WINDOWS (4)
+// quality index at which a single window is trusted
+#define CONFIDENT (60)
 #define MIN(x, y) (((x) > (y)) ? (y) : (x))
 // #define STRICT
 
+/**
+ * @brief capture windows until one is confident or two valid ones agree,
+ * | at most MAX_WINDOWS
+ */
+static uint8_t MAX30102_measure_hr() {
+    MAX30102_shutdown(1, 0);
+    uint8_t foo;
+    if (i2c_read(MAX30102, INTR_STATUS_1, 1, &foo) != ESP_OK) {
+        fuse();
+        return 0;
+    }
+    if (MAX30102_agc() != ESP_OK) {
+        MAX30102_shutdown(0, 0);
+        return 0;
+    }
+    led_pa_sum = 0;
+    led_pa_count = 0;
+    int32_t result = 0;
+    int32_t best = 0;
+    int32_t best_quality = -1;
+    uint8_t times;
+    for (times = 0; times < MAX_WINDOWS; times++) {
+        uint32_t sum = 0;
+        for (int i = 0; i < BUFFER_LENGTH; i++) {
+            uint32_t ir;
+            int64_t time;
+            if (MAX30102_next_sample(&ir, &time) != ESP_OK) {
+                MAX30102_shutdown(0, 0);
+                return 0;
+            }
+            packed_set(ir_buffer, i, ir);
+            MAX30102_accel_ref(time, accel_buffer[i]);
+            sum += ir;
+        }
+        led_pa_sum += (uint32_t)led_pa * BUFFER_LENGTH;
+        led_pa_count += BUFFER_LENGTH;
+        int32_t hr, quality;
+        int8_t valid;
+        maxim_motion_cancel(ir_buffer, accel_buffer, BUFFER_LENGTH);
+        maxim_heart_rate_saturation(ir_buffer, BUFFER_LENGTH, &hr, &valid,
+                                    &quality);
+        ESP_LOGI(TAG, "%i %i q%i", hr, valid, quality);
+        // track slow drift between windows, never inside one
+        MAX30102_agc_update(sum / BUFFER_LENGTH);
+        if (!valid || hr >= MAX_HR) {
+            continue;
+        }
+        if (quality >= CONFIDENT) {
+            result = hr;
+            break;
+        }
+        if (best_quality >= 0) {
+            int32_t temp = hr - best;
+            if (temp < MAX_DIFF && temp > -MAX_DIFF) {
+                result = MIN(hr, best);
+                break;
+            }
+        }
+        if (quality > best_quality) {
+            best = hr;
+            best_quality = quality;
+        }
+    }
+    MAX30102_shutdown(0, 0);
+    led_current = led_pa_sum * 2 / led_pa_count;
+    if (times < MAX_WINDOWS) {
+        times++;
+    }
+    ESP_LOGI(TAG, "%u windows, led %u.%u mA", times, led_current / 10,
+             led_current % 10);
+#ifndef STRICT
+    if (!result && best_quality >= 0) {
+        result = best;
+    }
+#endif
+    return result;
+}
+
 /**
  * @return heart rate
  * | if failed, return 0
  */
 uint8_t MAX30102_get_hr() {
-    if (status != running) {
+    if (status != running || stream_task) {
         return 0;
     }
-    MAX30102_shutdown(1, 0);
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    int32_t hr[2];
-    int8_t valid[2];
-    for (uint8_t times = 0; times < 2; times++) {
-        uint8_t foo;
-        if (i2c_read(MAX30102, INTR_STATUS_1, 1, &foo) != ESP_OK) {
-            fuse();
-            return 0;
+    NAR_BUS_request(NAR_BUS_ACCEL, 1);
+    uint8_t hr = MAX30102_measure_hr();
+    NAR_BUS_request(NAR_BUS_ACCEL, 0);
+    return hr;
+}
+
+#define DUAL_LENGTH (300)
+#define SAMPLE_US (10000)
+#define POLL_MS (20)
+#define CAPTURE_STACK_SIZE (3072)
+static uint8_t ir_buffer_2[PACKED_SIZE(DUAL_LENGTH)];
+
+typedef struct {
+    uint8_t which;
+    int64_t first;  // time of the first sample, us
+    int64_t last;   // time of the last sample, us
+    esp_err_t ret;
+    TaskHandle_t caller;
+} capture_t;
+
+static capture_t capture[2];
+
+/**
+ * @brief read all samples waiting in the FIFO of wear sensor, which has no
+ * INT line
+ * @param[out] ir_led packed buffer, samples are stored from index on
+ * @param[in] max room left in ir_led
+ * @return number of samples read, negative if failed
+ */
+static int MAX30102_read_fifo_burst_2(uint8_t* ir_led,
+                                      int32_t index,
+                                      int32_t max) {
+    uint8_t ptr[3];  // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    if (i2c_read_2(MAX30102, FIFO_WR_PTR, 3, ptr) != ESP_OK) {
+        fuse();
+        return -1;
+    }
+    uint8_t count = ptr[1] ? 32 : ((ptr[0] - ptr[2]) & 0x1F);
+    if (count > max) {
+        count = max;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    uint8_t read_buffer[32 * 6];
+    if (i2c_read_2(MAX30102, FIFO_DATA, count * 6, read_buffer) != ESP_OK) {
+        fuse();
+        return -1;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t* p = read_buffer + i * 6;
+        packed_set(ir_led, index + i,
+                   (((uint32_t)p[3] << 16) | (p[4] << 8) | p[5]) & 0x03FFFF);
+    }
+    return count;
+}
+
+/**
+ * @brief capture DUAL_LENGTH samples of one sensor, then notify the caller
+ */
+static void MAX30102_capture_task(void* pvParameters) {
+    capture_t* cap = pvParameters;
+    cap->ret = ESP_OK;
+    if (cap->which == 0) {
+        for (int i = 0; i < DUAL_LENGTH; i++) {
+            uint32_t ir;
+            int64_t time;
+            esp_err_t ret = MAX30102_next_sample(&ir, &time);
+            if (ret != ESP_OK) {
+                cap->ret = ret;
+                break;
+            }
+            packed_set(ir_buffer, i, ir);
+            MAX30102_accel_ref(time, accel_buffer[i]);
+            if (i == 0) {
+                cap->first = time;
+            }
+            cap->last = time;
         }
-        for (int i = 0; i < BUFFER_LENGTH; i++) {
-            while (NAR_GPIO_get_MAX30102_intr()) {
+    } else {
+        int n = 0;
+        int64_t idle = esp_timer_get_time();
+        while (n < DUAL_LENGTH) {
+            vTaskDelay(POLL_MS / portTICK_PERIOD_MS);
+            int got =
+                MAX30102_read_fifo_burst_2(ir_buffer_2, n, DUAL_LENGTH - n);
+            int64_t now = esp_timer_get_time();
+            if (got < 0 || now - idle > INTR_TIMEOUT_MS * 1000) {
+                cap->ret = ESP_FAIL;
+                break;
             }
-            if (MAX30102_read_fifo(ir_buffer + i, 0) != ESP_OK) {
-                return 0;
+            if (got == 0) {
+                continue;
+            }
+            // newest sample is the one just converted
+            if (n == 0) {
+                cap->first = now - (got - 1) * SAMPLE_US;
             }
+            n += got;
+            cap->last = now;
+            idle = now;
         }
-        maxim_heart_rate_saturation(ir_buffer, BUFFER_LENGTH, &hr[times],
-                                    &valid[times]);
-        ESP_LOGI(TAG, "%i %i", hr[times], valid[times]);
-        if (hr[times] >= MAX_HR) {
-            valid[times] = 0;
+    }
+    xTaskNotifyGive(cap->caller);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief resample wear sensor onto the INT edges of hr sensor and fuse both
+ * into ir_buffer. Each channel is normalised by its AC level and weighted by
+ * its perfusion (AC/DC), so both raw samples stay untouched for later.
+ */
+static void MAX30102_fuse() {
+    uint8_t* buffers[2] = {ir_buffer, ir_buffer_2};
+    float mean[2] = {0, 0}, ac[2] = {0, 0};
+    for (uint8_t c = 0; c < 2; c++) {
+        for (int i = 0; i < DUAL_LENGTH; i++) {
+            mean[c] += packed_get(buffers[c], i);
+        }
+        mean[c] /= DUAL_LENGTH;
+        for (int i = 0; i < DUAL_LENGTH; i++) {
+            float d = packed_get(buffers[c], i) - mean[c];
+            ac[c] += d > 0 ? d : -d;
+        }
+        ac[c] /= DUAL_LENGTH;
+        if (ac[c] == 0) {
+            return;
         }
     }
-    MAX30102_shutdown(0, 0);
-#ifdef STRICT
-    if (valid[0] && valid[1]) {
-        int32_t temp = hr[0] - hr[1];
-        if (temp < MAX_DIFF && temp > -MAX_DIFF) {
-            return MIN(hr[0], hr[1]);
+    // perfusion / AC == 1 / DC
+    float w1 = 1 / mean[0];
+    float w2 = 1 / mean[1];
+    // back to the units of hr sensor
+    float scale = ac[0] / (ac[0] * w1 + ac[1] * w2);
+    float span1 = capture[0].last - capture[0].first;
+    float span2 = capture[1].last - capture[1].first;
+    float offset = capture[0].first - capture[1].first;
+    for (int i = 0; i < DUAL_LENGTH; i++) {
+        float t = offset + span1 * i / (DUAL_LENGTH - 1);
+        float pos = t * (DUAL_LENGTH - 1) / span2;
+        if (pos < 0) {
+            pos = 0;
+        } else if (pos > DUAL_LENGTH - 1) {
+            pos = DUAL_LENGTH - 1;
+        }
+        int j = pos;
+        float x2 = packed_get(ir_buffer_2, j);
+        if (j < DUAL_LENGTH - 1) {
+            x2 += (pos - j) * (packed_get(ir_buffer_2, j + 1) - x2);
+        }
+        float x = w1 * (packed_get(ir_buffer, i) - mean[0]) +
+                  w2 * (x2 - mean[1]);
+        float out = mean[0] + x * scale;
+        packed_set(ir_buffer, i,
+                   out < 0 ? 0 : (out > 0x3FFFF ? 0x3FFFF : (int32_t)out));
+    }
+}
+
+/**
+ * @brief capture both sensors concurrently from two tasks pinned to
+ * different cores, then estimate on the fused signal
+ */
+static uint8_t MAX30102_measure_hr_dual() {
+    MAX30102_shutdown(1, 0);
+    MAX30102_shutdown(1, 1);
+    uint8_t foo;
+    if (i2c_read(MAX30102, INTR_STATUS_1, 1, &foo) != ESP_OK) {
+        fuse();
+        return 0;
+    }
+    if (MAX30102_agc() != ESP_OK) {
+        MAX30102_shutdown(0, 0);
+        MAX30102_shutdown(0, 1);
+        return 0;
+    }
+    // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    if (i2c_write_2(MAX30102, FIFO_WR_PTR, 3, (uint8_t[]){0, 0, 0}) !=
+        ESP_OK) {
+        fuse();
+        return 0;
+    }
+    for (uint8_t which = 0; which < 2; which++) {
+        capture[which].which = which;
+        capture[which].caller = xTaskGetCurrentTaskHandle();
+        capture[which].ret = ESP_FAIL;
+        TaskHandle_t xHandle = NULL;
+        xTaskCreatePinnedToCore(MAX30102_capture_task, "max30102",
+                                CAPTURE_STACK_SIZE, &capture[which],
+                                tskIDLE_PRIORITY + 4, &xHandle, 1 - which);
+        if (!xHandle) {
+            // out of memory for now, not broken, only this measurement is
+            // lost. The other task may already run, let it finish first
+            ESP_LOGW(TAG, "no memory for capture task %u", which);
+            if (which == 1) {
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            MAX30102_shutdown(0, 0);
+            MAX30102_shutdown(0, 1);
+            return 0;
         }
+    }
+    // both tasks give up on their own after INTR_TIMEOUT_MS without data
+    for (uint8_t n = 0; n < 2; n++) {
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    }
+    MAX30102_shutdown(0, 0);
+    MAX30102_shutdown(0, 1);
+    if (capture[0].ret != ESP_OK || capture[1].ret != ESP_OK ||
+        capture[1].last <= capture[1].first) {
         return 0;
     }
-    return 0;
-#else
-    if (valid[0]) {
-        if (valid[1]) {
-            return MIN(hr[0], hr[1]);
-        } else {
-            return hr[0];
+    led_current = led_pa * 2;
+
+    // estimation filters in place, so fuse before, the hr sensor alone is
+    // not kept
+    MAX30102_fuse();
+    maxim_motion_cancel(ir_buffer, accel_buffer, DUAL_LENGTH);
+    int32_t hr[2], quality[2];
+    int8_t valid[2];
+    maxim_heart_rate_saturation(ir_buffer, DUAL_LENGTH, &hr[0], &valid[0],
+                                &quality[0]);
+    maxim_heart_rate_saturation(ir_buffer_2, DUAL_LENGTH, &hr[1], &valid[1],
+                                &quality[1]);
+    ESP_LOGI(TAG, "fused %i q%i, wear %i q%i", hr[0], quality[0], hr[1],
+             quality[1]);
+    // best quality wins, the fused estimate on a tie
+    int32_t result = 0;
+    int32_t best_quality = -1;
+    for (uint8_t i = 0; i < 2; i++) {
+        if (valid[i] && hr[i] < MAX_HR && quality[i] > best_quality) {
+            result = hr[i];
+            best_quality = quality[i];
         }
-    } else if (valid[1]) {
-        return hr[1];
     }
-    return 0;
+#ifdef STRICT
+    if (best_quality < CONFIDENT) {
+        return 0;
+    }
 #endif
+    return result;
+}
+
+/**
+ * @brief like MAX30102_get_hr, but samples hr and wear sensor at the same
+ * time over a shorter window
+ * @return heart rate
+ * | if failed, return 0
+ */
+uint8_t MAX30102_get_hr_dual() {
+    if (status != running || stream_task) {
+        return 0;
+    }
+    NAR_BUS_request(NAR_BUS_ACCEL, 1);
+    uint8_t hr = MAX30102_measure_hr_dual();
+    NAR_BUS_request(NAR_BUS_ACCEL, 0);
+    return hr;
+}
+
+// allowance per window for motion cancel and estimation on the ESP32
+#define ESTIMATE_MS (100)
+
+/**
+ * @brief worst case of MAX30102_get_hr() and MAX30102_get_hr_dual(), for
+ * deadlines: AGC at most, then every window, one INT per SAMPLE_US. A
+ * missed INT ends the measurement after INTR_TIMEOUT_MS.
+ * @return ms
+ */
+uint32_t MAX30102_get_hr_max_ms() {
+    uint32_t agc = AGC_ROUNDS * (AGC_SKIP + AGC_SAMPLES);
+    uint32_t single = (agc + MAX_WINDOWS * BUFFER_LENGTH) * SAMPLE_US / 1000 +
+                      MAX_WINDOWS * ESTIMATE_MS;
+    uint32_t dual = (agc + DUAL_LENGTH) * SAMPLE_US / 1000 + POLL_MS +
+                    ESTIMATE_MS;
+    return (single > dual ? single : dual) + INTR_TIMEOUT_MS;
+}
+
+#define STREAM_POLL_MS (40)
+#define STREAM_STACK_SIZE (3072)
+// a stopping stream task is done within a poll, wait that long and more
+#define STOP_WAIT_MS (500)
+static volatile uint8_t streaming = 0;
+static uint32_t stream_samples = 0;
+static uint32_t stream_overflows = 0;
+
+/**
+ * @brief read all samples waiting in the FIFO of hr sensor and publish them
+ * to NAR_BUS, the newest one was converted just now
+ * @return number of samples read, negative if failed
+ */
+static int MAX30102_read_fifo_burst() {
+    uint8_t ptr[3];  // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    if (i2c_read(MAX30102, FIFO_WR_PTR, 3, ptr) != ESP_OK) {
+        fuse();
+        return -1;
+    }
+    uint8_t count = ptr[1] ? 32 : ((ptr[0] - ptr[2]) & 0x1F);
+    stream_overflows += ptr[1];
+    if (count == 0) {
+        return 0;
+    }
+    uint8_t read_buffer[32 * 6];
+    if (i2c_read(MAX30102, FIFO_DATA, count * 6, read_buffer) != ESP_OK) {
+        fuse();
+        return -1;
+    }
+    int64_t now = esp_timer_get_time();
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t* p = read_buffer + i * 6;
+        int32_t red = (((uint32_t)p[0] << 16) | (p[1] << 8) | p[2]) & 0x03FFFF;
+        int32_t ir = (((uint32_t)p[3] << 16) | (p[4] << 8) | p[5]) & 0x03FFFF;
+        NAR_BUS_push(NAR_BUS_PPG, now - (count - 1 - i) * SAMPLE_US,
+                     (int32_t[]){ir, red, 0});
+    }
+    stream_samples += count;
+    return count;
+}
+
+/**
+ * @brief keeps the hr sensor running and drains its 32 deep FIFO every
+ * STREAM_POLL_MS, far within the 320 ms it takes to fill at 100 Hz
+ */
+static void MAX30102_stream_task(void* pvParameters) {
+    stream_samples = 0;
+    stream_overflows = 0;
+    MAX30102_shutdown(1, 0);
+    // FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR
+    if (MAX30102_set_pa(led_pa) != ESP_OK ||
+        i2c_write(MAX30102, FIFO_WR_PTR, 3, (uint8_t[]){0, 0, 0}) != ESP_OK) {
+        fuse();
+        streaming = 0;
+    }
+    TickType_t last = xTaskGetTickCount();
+    while (streaming && status == running) {
+        vTaskDelayUntil(&last, STREAM_POLL_MS / portTICK_PERIOD_MS);
+        if (MAX30102_read_fifo_burst() < 0) {
+            break;
+        }
+    }
+    MAX30102_shutdown(0, 0);
+    ESP_LOGI(TAG, "streamed %u samples, %u lost in FIFO", stream_samples,
+             stream_overflows);
+    streaming = 0;
+    stream_task = NULL;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief raw ir / red of hr sensor to NAR_BUS at 100 Hz, until stopped. No
+ * hr measurement meanwhile, the caller must not start it during one.
+ * @param[in] on_off
+ * | 1 - start, waits up to STOP_WAIT_MS for the last stream to stop first
+ * | 0 - stop within STREAM_POLL_MS
+ */
+void MAX30102_stream(uint8_t on_off) {
+    if (status != running) {
+        return;
+    }
+    if (!on_off) {
+        streaming = 0;
+        return;
+    }
+    if (streaming) {
+        return;
+    }
+    // stopped just now, the old task still has to let go of the sensor
+    for (uint8_t i = 0; stream_task && i < STOP_WAIT_MS / STREAM_POLL_MS;
+         i++) {
+        vTaskDelay(STREAM_POLL_MS / portTICK_PERIOD_MS);
+    }
+    if (stream_task) {
+        ESP_LOGW(TAG, "last stream still stopping");
+        return;
+    }
+    streaming = 1;
+    xTaskCreate(MAX30102_stream_task, "ppg_stream", STREAM_STACK_SIZE, NULL,
+                tskIDLE_PRIORITY + 3, &stream_task);
+    if (stream_task == NULL) {
+        streaming = 0;
+        fuse();
+    }
+}
+
+/**
+ * @return 1 while streaming
+ */
+uint8_t MAX30102_get_streaming() {
+    return stream_task != NULL;
 }
\ No newline at end of file
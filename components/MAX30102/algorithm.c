@@ -58,40 +58,53 @@
  */
 
 #include "esp_types.h"
+#include "packed.h"
 
 #define FS 100
 #define BUFFER_SIZE (FS * 5)
 #define MA4_SIZE 4      // DO NOT CHANGE
 #define HAMMING_SIZE 5  // DO NOT CHANGE
+#define MAX_PI 100      // perfusion index limit, in 0.1%
+#define NLMS_TAPS 3     // per accelerometer axis
+#define NLMS_STRIDE 4   // samples between taps
+#define NLMS_PASSES 3   // only the last pass writes the output
+#define NLMS_MU 0.01f
+#define NLMS_EPS 1.0f
+#define NLMS_MIN_VAR 2  // reference variance below this means no motion
+#define NLMS_LEFT 0.5f  // share of ir power left, above it no output
 #define min(x, y) ((x) < (y) ? (x) : (y))
 
 static const uint16_t auw_hamm[31] = {41, 276, 512, 276, 41};
 // Hamm=  long16(512* hamming(5)');
 // uch_spo2_table is computed as  -45.060*ratioAverage* ratioAverage + 30.354
 // *ratioAverage + 94.845 ;
-static int32_t an_dx[BUFFER_SIZE - MA4_SIZE];  // delta
-static int32_t an_x[BUFFER_SIZE];              // ir
+// every stage below filters the packed ir buffer in place, so there are no
+// separate an_x / an_dx arrays
 
 static void maxim_peaks_above_min_height(int32_t* pn_locs,
                                          int32_t* pn_npks,
-                                         int32_t* pn_x,
+                                         uint8_t* puch_x,
                                          int32_t n_size,
                                          int32_t n_min_height);
 static void maxim_remove_close_peaks(int32_t* pn_locs,
                                      int32_t* pn_npks,
-                                     int32_t* pn_x,
+                                     uint8_t* puch_x,
                                      int32_t n_min_distance);
 static void maxim_sort_ascend(int32_t* pn_x, int32_t n_size);
-static void maxim_sort_indices_descend(int32_t* pn_x,
+static void maxim_sort_indices_descend(uint8_t* puch_x,
                                        int32_t* pn_indx,
                                        int32_t n_size);
 static void maxim_find_peaks(int32_t* pn_locs,
                              int32_t* pn_npks,
-                             int32_t* pn_x,
+                             uint8_t* puch_x,
                              int32_t n_size,
                              int32_t n_min_height,
                              int32_t n_min_distance,
                              int32_t n_max_num);
+static int32_t maxim_signal_quality(int32_t* pn_locs,
+                                    int32_t n_npks,
+                                    int32_t n_ac,
+                                    uint32_t un_dc);
 
 /**
  * \brief        Calculate the heart rate and SpO2 level
@@ -102,62 +115,93 @@ static void maxim_find_peaks(int32_t* pn_locs,
  * accuracy due to register overflow. Thus, accurate SPO2 is precalculated and
  * save longo uch_spo2_table[] per each ratio.
  *
- * \param[in]    ir_buffer           - IR sensor data buffer
- * \param[in]    buffer_length      - IR sensor data buffer length
+ * \param[in,out] ir_buffer          - IR sensor data buffer, packed.
+ * Filtered in place, the samples are gone afterwards
+ * \param[in]    buffer_length      - IR sensor data buffer length, at most
+ * BUFFER_SIZE
  * \param[out]    heart_rate          - Calculated heart rate value
  * \param[out]    hr_valid           - 1 if the calculated heart rate value
  * is valid
+ * \param[out]    hr_quality         - Signal quality index, 0 - 100.
+ * Nullable
  *
  * \retval       None
  */
-void maxim_heart_rate_saturation(uint32_t* ir_buffer,
+void maxim_heart_rate_saturation(uint8_t* ir_buffer,
                                  int32_t buffer_length,
                                  int32_t* heart_rate,
-                                 int8_t* hr_valid) {
+                                 int8_t* hr_valid,
+                                 int32_t* hr_quality) {
     uint32_t un_ir_mean;
     int32_t k, i, s, n_th1, n_npks, an_dx_peak_locs[15], n_peak_interval_sum;
+    int32_t n_x, n_x_min, n_x_max;
+    if (buffer_length > BUFFER_SIZE ||
+        buffer_length <= HAMMING_SIZE + MA4_SIZE + 2) {
+        *heart_rate = -999;
+        *hr_valid = 0;
+        if (hr_quality)
+            *hr_quality = 0;
+        return;
+    }
     // remove DC of ir signal
     un_ir_mean = 0;
     for (k = 0; k < buffer_length; k++)
-        un_ir_mean += ir_buffer[k];
+        un_ir_mean += packed_get(ir_buffer, k);
     un_ir_mean = un_ir_mean / buffer_length;
     for (k = 0; k < buffer_length; k++)
-        an_x[k] = ir_buffer[k] - un_ir_mean;
+        packed_set(ir_buffer, k,
+                   packed_get(ir_buffer, k) - (int32_t)un_ir_mean);
 
     // 4 pt Moving Average
-    for (k = 0; k < BUFFER_SIZE - MA4_SIZE; k++) {
-        an_x[k] = (an_x[k] + an_x[k + 1] + an_x[k + 2] + an_x[k + 3]) / 4;
+    n_x_min = n_x_max = 0;
+    for (k = 0; k < buffer_length - MA4_SIZE; k++) {
+        n_x = (packed_get(ir_buffer, k) + packed_get(ir_buffer, k + 1) +
+               packed_get(ir_buffer, k + 2) + packed_get(ir_buffer, k + 3)) /
+              4;
+        packed_set(ir_buffer, k, n_x);
+        if (n_x < n_x_min)
+            n_x_min = n_x;
+        if (n_x > n_x_max)
+            n_x_max = n_x;
     }
 
     // get difference of smoothed IR signal
 
-    for (k = 0; k < BUFFER_SIZE - MA4_SIZE - 1; k++)
-        an_dx[k] = (an_x[k + 1] - an_x[k]);
+    for (k = 0; k < buffer_length - MA4_SIZE - 1; k++)
+        packed_set(ir_buffer, k,
+                   packed_get(ir_buffer, k + 1) - packed_get(ir_buffer, k));
 
     // 2-pt Moving Average to an_dx
-    for (k = 0; k < BUFFER_SIZE - MA4_SIZE - 2; k++) {
-        an_dx[k] = (an_dx[k] + an_dx[k + 1]) / 2;
+    for (k = 0; k < buffer_length - MA4_SIZE - 2; k++) {
+        packed_set(
+            ir_buffer, k,
+            (packed_get(ir_buffer, k) + packed_get(ir_buffer, k + 1)) / 2);
     }
 
     // hamming window
     // flip wave form so that we can detect valley with peak detector
-    for (i = 0; i < BUFFER_SIZE - HAMMING_SIZE - MA4_SIZE - 2; i++) {
+    for (i = 0; i < buffer_length - HAMMING_SIZE - MA4_SIZE - 2; i++) {
         s = 0;
         for (k = i; k < i + HAMMING_SIZE; k++) {
-            s -= an_dx[k] * auw_hamm[k - i];
+            s -= packed_get(ir_buffer, k) * auw_hamm[k - i];
         }
-        an_dx[i] = s / (int32_t)1146;  // divide by sum of auw_hamm
+        // divide by sum of auw_hamm
+        packed_set(ir_buffer, i, s / (int32_t)1146);
     }
 
     n_th1 = 0;  // threshold calculation
-    for (k = 0; k < BUFFER_SIZE - HAMMING_SIZE; k++) {
-        n_th1 += ((an_dx[k] > 0) ? an_dx[k] : ((int32_t)0 - an_dx[k]));
+    for (k = 0; k < buffer_length - HAMMING_SIZE; k++) {
+        n_x = packed_get(ir_buffer, k);
+        n_th1 += ((n_x > 0) ? n_x : ((int32_t)0 - n_x));
     }
-    n_th1 = n_th1 / (BUFFER_SIZE - HAMMING_SIZE);
+    n_th1 = n_th1 / (buffer_length - HAMMING_SIZE);
+    // a flat peak at the end is compared with the sample past n_size, which
+    // was always 0 in the separate an_dx array
+    packed_set(ir_buffer, buffer_length - HAMMING_SIZE, 0);
     // peak location is acutally index for sharpest location of raw signal since
     // we flipped the signal
-    maxim_find_peaks(an_dx_peak_locs, &n_npks, an_dx,
-                     BUFFER_SIZE - HAMMING_SIZE, n_th1, 8,
+    maxim_find_peaks(an_dx_peak_locs, &n_npks, ir_buffer,
+                     buffer_length - HAMMING_SIZE, n_th1, 8,
                      5);  // peak_height, peak_distance, max_num_peaks
 
     n_peak_interval_sum = 0;
@@ -174,6 +218,133 @@ void maxim_heart_rate_saturation(uint32_t* ir_buffer,
         *heart_rate = -999;
         *hr_valid = 0;
     }
+    if (hr_quality)
+        *hr_quality = maxim_signal_quality(
+            an_dx_peak_locs, n_npks, n_x_max - n_x_min, un_ir_mean);
+}
+
+/**
+ * \brief        Signal quality index
+ * \par          Details
+ *               Combine peak regularity (mean absolute deviation of peak
+ * intervals) and perfusion (AC/DC ratio of the smoothed IR signal) into a
+ * 0 - 100 score. The weaker of the two limits the result.
+ *
+ * \retval       Signal quality index
+ */
+static int32_t maxim_signal_quality(int32_t* pn_locs,
+                                    int32_t n_npks,
+                                    int32_t n_ac,
+                                    uint32_t un_dc) {
+    int32_t k, n_d, n_mean, n_dev, n_reg, n_pi, n_perf;
+    // need at least 2 intervals to judge regularity
+    if (n_npks < 3 || un_dc == 0)
+        return 0;
+    n_mean = (pn_locs[n_npks - 1] - pn_locs[0]) / (n_npks - 1);
+    if (n_mean <= 0)
+        return 0;
+    n_dev = 0;
+    for (k = 1; k < n_npks; k++) {
+        n_d = pn_locs[k] - pn_locs[k - 1] - n_mean;
+        n_dev += (n_d > 0) ? n_d : -n_d;
+    }
+    n_dev /= (n_npks - 1);
+    // relative deviation of 25% or more scores 0
+    n_reg = 100 - n_dev * 400 / n_mean;
+    // perfusion index in 0.1%, 0.4% and above is fine, above 10% is motion
+    n_pi = (int32_t)((int64_t)n_ac * 1000 / un_dc);
+    if (n_pi > MAX_PI)
+        n_perf = 0;
+    else
+        n_perf = min(n_pi * 25, 100);
+    return (n_reg < 0) ? 0 : min(n_reg, n_perf);
+}
+
+/**
+ * \brief        Motion artifact cancellation
+ * \par          Details
+ *               Normalized LMS adaptive filter. The 3-axis accelerometer,
+ * sampled at the same instants as the IR signal, is the noise reference; the
+ * part of the IR signal it can predict is removed in place. Buffers with no
+ * motion are left untouched, and so are buffers where it predicts less than
+ * half the IR power: there the fit follows the pulse rather than the motion.
+ *
+ * \param[in,out] puch_ir_buffer    - IR sensor data buffer, packed
+ * \param[in]    pach_ref           - Accelerometer reference, one row per IR
+ * sample
+ * \param[in]    n_buffer_length    - IR sensor data buffer length
+ *
+ * \retval       None
+ */
+void maxim_motion_cancel(uint8_t* puch_ir_buffer,
+                         int8_t (*pach_ref)[3],
+                         int32_t n_buffer_length) {
+    uint32_t un_ir_mean;
+    int32_t k, j, a, p, an_ref_mean[3], n_var, n_d, n_out;
+    float af_w[3][NLMS_TAPS], f_u, f_y, f_e, f_power, f_in, f_left;
+
+    un_ir_mean = 0;
+    an_ref_mean[0] = an_ref_mean[1] = an_ref_mean[2] = 0;
+    for (k = 0; k < n_buffer_length; k++) {
+        un_ir_mean += packed_get(puch_ir_buffer, k);
+        for (a = 0; a < 3; a++)
+            an_ref_mean[a] += pach_ref[k][a];
+    }
+    un_ir_mean = un_ir_mean / n_buffer_length;
+    for (a = 0; a < 3; a++)
+        an_ref_mean[a] /= n_buffer_length;
+
+    n_var = 0;
+    for (k = 0; k < n_buffer_length; k++) {
+        for (a = 0; a < 3; a++) {
+            n_d = pach_ref[k][a] - an_ref_mean[a];
+            n_var += n_d * n_d;
+        }
+    }
+    if (n_var / n_buffer_length < NLMS_MIN_VAR)
+        return;
+
+    for (a = 0; a < 3; a++)
+        for (j = 0; j < NLMS_TAPS; j++)
+            af_w[a][j] = 0.0f;
+    for (p = 0; p < NLMS_PASSES; p++) {
+        f_in = f_left = 0.0f;
+        for (k = (NLMS_TAPS - 1) * NLMS_STRIDE; k < n_buffer_length; k++) {
+            f_y = 0.0f;
+            f_power = NLMS_EPS;
+            for (a = 0; a < 3; a++) {
+                for (j = 0; j < NLMS_TAPS; j++) {
+                    f_u = (float)(pach_ref[k - j * NLMS_STRIDE][a] -
+                                  an_ref_mean[a]);
+                    f_y += af_w[a][j] * f_u;
+                    f_power += f_u * f_u;
+                }
+            }
+            f_e = (float)(packed_get(puch_ir_buffer, k) -
+                          (int32_t)un_ir_mean) -
+                  f_y;
+            for (a = 0; a < 3; a++) {
+                for (j = 0; j < NLMS_TAPS; j++) {
+                    f_u = (float)(pach_ref[k - j * NLMS_STRIDE][a] -
+                                  an_ref_mean[a]);
+                    af_w[a][j] += NLMS_MU * f_e * f_u / f_power;
+                }
+            }
+            f_in += (f_e + f_y) * (f_e + f_y);
+            f_left += f_e * f_e;
+            if (p < NLMS_PASSES - 1)
+                continue;
+            n_out = (int32_t)un_ir_mean + (int32_t)f_e;
+            if (n_out < 0)
+                n_out = 0;
+            else if (n_out > 0x3FFFF)
+                n_out = 0x3FFFF;
+            packed_set(puch_ir_buffer, k, n_out);
+        }
+        // the weights have settled by the pass before the output
+        if (p == NLMS_PASSES - 2 && f_left > NLMS_LEFT * f_in)
+            return;
+    }
 }
 
 /**
@@ -186,13 +357,14 @@ void maxim_heart_rate_saturation(uint32_t* ir_buffer,
  */
 static void maxim_find_peaks(int32_t* pn_locs,
                              int32_t* pn_npks,
-                             int32_t* pn_x,
+                             uint8_t* puch_x,
                              int32_t n_size,
                              int32_t n_min_height,
                              int32_t n_min_distance,
                              int32_t n_max_num) {
-    maxim_peaks_above_min_height(pn_locs, pn_npks, pn_x, n_size, n_min_height);
-    maxim_remove_close_peaks(pn_locs, pn_npks, pn_x, n_min_distance);
+    maxim_peaks_above_min_height(pn_locs, pn_npks, puch_x, n_size,
+                                 n_min_height);
+    maxim_remove_close_peaks(pn_locs, pn_npks, puch_x, n_min_distance);
     *pn_npks = min(*pn_npks, n_max_num);
 }
 
@@ -205,20 +377,21 @@ static void maxim_find_peaks(int32_t* pn_locs,
  */
 static void maxim_peaks_above_min_height(int32_t* pn_locs,
                                          int32_t* pn_npks,
-                                         int32_t* pn_x,
+                                         uint8_t* puch_x,
                                          int32_t n_size,
                                          int32_t n_min_height) {
-    int32_t i = 1, n_width;
+    int32_t i = 1, n_width, n_x;
     *pn_npks = 0;
 
     while (i < n_size - 1) {
-        if (pn_x[i] > n_min_height &&
-            pn_x[i] > pn_x[i - 1]) {  // find left edge of potential peaks
+        n_x = packed_get(puch_x, i);
+        // find left edge of potential peaks
+        if (n_x > n_min_height && n_x > packed_get(puch_x, i - 1)) {
             n_width = 1;
             while (i + n_width < n_size &&
-                   pn_x[i] == pn_x[i + n_width])  // find flat peaks
+                   n_x == packed_get(puch_x, i + n_width))  // find flat peaks
                 n_width++;
-            if (pn_x[i] > pn_x[i + n_width] &&
+            if (n_x > packed_get(puch_x, i + n_width) &&
                 (*pn_npks) < 15) {  // find right edge of peaks
                 pn_locs[(*pn_npks)++] = i;
                 // for flat peaks, peak location is left edge
@@ -239,12 +412,12 @@ static void maxim_peaks_above_min_height(int32_t* pn_locs,
  */
 static void maxim_remove_close_peaks(int32_t* pn_locs,
                                      int32_t* pn_npks,
-                                     int32_t* pn_x,
+                                     uint8_t* puch_x,
                                      int32_t n_min_distance) {
     int32_t i, j, n_old_npks, n_dist;
 
     /* Order peaks from large to small */
-    maxim_sort_indices_descend(pn_x, pn_locs, *pn_npks);
+    maxim_sort_indices_descend(puch_x, pn_locs, *pn_npks);
 
     for (i = -1; i < *pn_npks; i++) {
         n_old_npks = *pn_npks;
@@ -289,13 +462,15 @@ static void maxim_sort_ascend(int32_t* pn_x, int32_t n_size) {
  *
  * \retval       None
  */
-static void maxim_sort_indices_descend(int32_t* pn_x,
+static void maxim_sort_indices_descend(uint8_t* puch_x,
                                        int32_t* pn_indx,
                                        int32_t n_size) {
     int32_t i, j, n_temp;
     for (i = 1; i < n_size; i++) {
         n_temp = pn_indx[i];
-        for (j = i; j > 0 && pn_x[n_temp] > pn_x[pn_indx[j - 1]]; j--)
+        for (j = i; j > 0 && packed_get(puch_x, n_temp) >
+                                 packed_get(puch_x, pn_indx[j - 1]);
+             j--)
             pn_indx[j] = pn_indx[j - 1];
         pn_indx[j] = n_temp;
     }
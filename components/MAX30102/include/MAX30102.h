@@ -15,8 +15,18 @@ void MAX30102_init();
 
 uint8_t MAX30102_get_hr();
 
+uint8_t MAX30102_get_hr_dual();
+
+uint32_t MAX30102_get_hr_max_ms();
+
 double MAX30102_get_temp();
 
 uint8_t MAX30102_on();
 
+uint16_t MAX30102_get_led_current();
+
+void MAX30102_stream(uint8_t on_off);
+
+uint8_t MAX30102_get_streaming();
+
 #endif
\ No newline at end of file
@@ -65,9 +65,14 @@
 
 #include "inttypes.h"
 
-void maxim_heart_rate_saturation(uint32_t* ir_buffer,
+void maxim_heart_rate_saturation(uint8_t* ir_buffer,
                                  int32_t buffer_length,
                                  int32_t* heart_rate,
-                                 int8_t* hr_valid);
+                                 int8_t* hr_valid,
+                                 int32_t* hr_quality);
+
+void maxim_motion_cancel(uint8_t* puch_ir_buffer,
+                         int8_t (*pach_ref)[3],
+                         int32_t n_buffer_length);
 
 #endif /* ALGORITHM_H_ */
\ No newline at end of file
@@ -0,0 +1,29 @@
+/**
+ * @file packed.h
+ * @brief packed sample storage. Every sample takes 3 bytes and holds a
+ * signed 24-bit value, enough for an 18-bit ADC reading and for every
+ * intermediate result of algorithm.c, so buffers can be filtered in place.
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_PACKED
+#define NARUKARA_PACKED
+
+#include "esp_types.h"
+
+#define PACKED_SIZE(n) ((n)*3)
+
+static inline int32_t packed_get(const uint8_t* buffer, int32_t index) {
+    const uint8_t* p = buffer + index * 3;
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                     ((uint32_t)(int8_t)p[2] << 16));
+}
+
+static inline void packed_set(uint8_t* buffer, int32_t index, int32_t value) {
+    uint8_t* p = buffer + index * 3;
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+}
+
+#endif
@@ -5,12 +5,33 @@
  * @author Narukara
  * @date 2021.2
  */
+#include "NAR_BUS.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "inv_mpu.h"
 #include "inv_mpu_dmp_motion_driver.h"
 
 #define DEFAULT_MPU_HZ (100)
+#define STACK_SIZE (2048)
+#define DRAIN_PERIOD_MS (10)
+#define FIFO_PERIOD_MS (40)
+#define FIFO_BUDGET (32)
+#define DMP_FIFO_HZ (50)
+
+/**
+ * Raise gesture, from the gravity direction of the 6-axis quaternion. The
+ * screen faces up when gravity is within about 37 degrees of the screen
+ * normal. Turning from facing away to facing up within RAISE_WINDOW_US is a
+ * raise, lying face up on a table is not.
+ */
+#define RAISE_FACE_UP (0.8f)
+#define RAISE_FACE_AWAY (0.3f)
+#define RAISE_WINDOW_US (800000)
+#define Q30 (1073741824.0f)
 
 static const char* TAG = "MPU6050";
 
@@ -22,6 +43,12 @@ static enum { ready, running, error } status = ready;
         ESP_LOGE(TAG, "fuse at %d", __LINE__); \
     })
 
+/**
+ * @brief register access of inv_mpu is not atomic (bank select, then
+ * read), so the drain task and the API must not interleave
+ */
+static SemaphoreHandle_t lock = NULL;
+
 static const int8_t gyro_orientation[9] = {-1, 0, 0, 0, -1, 0, 0, 0, 1};
 
 static uint16_t inv_row_2_scale(const int8_t* row) {
@@ -51,14 +78,106 @@ static inline uint16_t inv_orientation_matrix_to_scalar(const int8_t* mtx) {
     return scalar;
 }
 
-// static void tap_cb(uint8_t direction, uint8_t count) {
-//     ESP_LOGI(TAG, "tap_cd");
-// }
+static void (*tap_callback)() = NULL;
+static void (*raise_callback)(int64_t time) = NULL;
+static int64_t away_time = 0;
+static uint8_t face_up = 0;
+
+static void tap_cb(unsigned char direction, unsigned char count) {
+    ESP_LOGD(TAG, "tap %u x%u", direction, count);
+    if (tap_callback) {
+        tap_callback();
+    }
+}
 
 // static void android_orient_cb(uint8_t orientation) {
 //     ESP_LOGI(TAG, "android_orient_cd");
 // }
 
+/**
+ * @param[in] quat q30 quaternion from the DMP
+ * @param[in] time when it was sampled, us
+ */
+static void MPU6050_detect_raise(const long quat[4], int64_t time) {
+    float q0 = quat[0] / Q30;
+    float q1 = quat[1] / Q30;
+    float q2 = quat[2] / Q30;
+    float q3 = quat[3] / Q30;
+    // z of gravity in the sensor frame
+    float gz = q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3;
+    if (gz < RAISE_FACE_AWAY) {
+        away_time = time;
+        face_up = 0;
+    } else if (gz > RAISE_FACE_UP && !face_up) {
+        face_up = 1;
+        if (time - away_time < RAISE_WINDOW_US && raise_callback) {
+            ESP_LOGD(TAG, "raise");
+            raise_callback(time);
+        }
+    }
+}
+
+/**
+ * @brief read out the DMP FIFO, decoding it runs the gesture callbacks
+ */
+static void MPU6050_read_fifo() {
+    short gyro[3], accel[3], sensors;
+    long quat[4];
+    unsigned long timestamp;
+    unsigned char more = 0;
+    uint8_t budget = FIFO_BUDGET;
+    do {
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int ret = dmp_read_fifo(gyro, accel, quat, &timestamp, &sensors, &more);
+        xSemaphoreGive(lock);
+        if (ret) {
+            // empty, or overflowed and reset by the driver
+            return;
+        }
+        // every packet still queued behind this one is a period younger
+        int64_t time =
+            esp_timer_get_time() - (int64_t)more * 1000000 / DMP_FIFO_HZ;
+        MPU6050_detect_raise(quat, time);
+    } while (more && --budget);
+}
+
+/**
+ * @brief drain task, publishes accelerometer samples to NAR_BUS while
+ * someone requests them, and reads gestures from the DMP FIFO
+ */
+static void MPU6050_task(void* pvParameters) {
+    TickType_t last = xTaskGetTickCount();
+    TickType_t last_fifo = last;
+    TickType_t fifo_period = FIFO_PERIOD_MS / portTICK_PERIOD_MS;
+    while (status == running) {
+        if (xTaskGetTickCount() - last_fifo >= fifo_period) {
+            last_fifo = xTaskGetTickCount();
+            MPU6050_read_fifo();
+        }
+        if (!NAR_BUS_requested(NAR_BUS_ACCEL)) {
+            // sleep only until the next FIFO read, a raise is seen within
+            // FIFO_PERIOD_MS
+            TickType_t passed = xTaskGetTickCount() - last_fifo;
+            vTaskDelay(passed < fifo_period ? fifo_period - passed : 1);
+            last = xTaskGetTickCount();
+            continue;
+        }
+        short accel[3];
+        unsigned long foo;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        int ret = mpu_get_accel_reg(accel, &foo);
+        xSemaphoreGive(lock);
+        if (ret) {
+            fuse();
+            break;
+        }
+        NAR_BUS_push(NAR_BUS_ACCEL, esp_timer_get_time(),
+                     (int32_t[]){accel[0], accel[1], accel[2]});
+        vTaskDelayUntil(&last, DRAIN_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+    vTaskDelete(NULL);
+}
+
 void MPU6050_init() {
     if (status != ready) {
         return;
@@ -96,22 +215,22 @@ void MPU6050_init() {
         return;
     }
 
-    // if (dmp_register_tap_cb(tap_cb)) {
-    //     ESP_ERROR_CHECK_WITHOUT_ABORT(ESP_FAIL);
-    //     return ESP_FAIL;
-    // }
+    if (dmp_register_tap_cb(tap_cb)) {
+        fuse();
+        return;
+    }
 
     // if (dmp_register_android_orient_cb(android_orient_cb)) {
     //     ESP_ERROR_CHECK_WITHOUT_ABORT(ESP_FAIL);
     //     return ESP_FAIL;
     // }
 
-    if (dmp_enable_feature(DMP_FEATURE_TAP)) {
+    if (dmp_enable_feature(DMP_FEATURE_TAP | DMP_FEATURE_6X_LP_QUAT)) {
         fuse();
         return;
     }
 
-    if (dmp_set_fifo_rate(DEFAULT_MPU_HZ)) {
+    if (dmp_set_fifo_rate(DMP_FIFO_HZ)) {
         fuse();
         return;
     }
@@ -120,10 +239,48 @@ void MPU6050_init() {
         fuse();
         return;
     }
+
+    // consumers of the raw accelerometer samples derive their scale from
+    // the full scale range mpu_init() set
+    unsigned short accel_sens;
+    if (mpu_get_accel_sens(&accel_sens)) {
+        fuse();
+        return;
+    }
+    NAR_BUS_set_scale(NAR_BUS_ACCEL, accel_sens);
+
+    lock = xSemaphoreCreateMutex();
+    if (!lock) {
+        fuse();
+        return;
+    }
     status = running;
+    TaskHandle_t xHandle = NULL;
+    xTaskCreate(MPU6050_task, "mpu6050", STACK_SIZE, NULL,
+                tskIDLE_PRIORITY + 5, &xHandle);
+    if (!xHandle) {
+        fuse();
+        return;
+    }
     ESP_LOGI(TAG, "mpu6050 init");
 }
 
+/**
+ * @brief callback runs in the MPU6050 task on every tap gesture
+ * @param[in] callback Nullable
+ */
+void MPU6050_set_tap_callback(void (*callback)()) {
+    tap_callback = callback;
+}
+
+/**
+ * @brief callback runs in the MPU6050 task when the wrist is raised
+ * @param[in] callback Nullable, gets when the raise completed, us
+ */
+void MPU6050_set_raise_callback(void (*callback)(int64_t time)) {
+    raise_callback = callback;
+}
+
 /**
  * @return step. 999999 if failed
  */
@@ -132,7 +289,10 @@ unsigned long MPU6050_get_step() {
         return 999999;
     }
     unsigned long count;
-    if (dmp_get_pedometer_step_count(&count)) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int ret = dmp_get_pedometer_step_count(&count);
+    xSemaphoreGive(lock);
+    if (ret) {
         fuse();
         return 999999;
     }
@@ -143,7 +303,10 @@ void MPU6050_set_step(unsigned long count) {
     if (status != running) {
         return;
     }
-    if (dmp_set_pedometer_step_count(count)) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int ret = dmp_set_pedometer_step_count(count);
+    xSemaphoreGive(lock);
+    if (ret) {
         fuse();
     }
 }
\ No newline at end of file
@@ -16,4 +16,8 @@ unsigned long MPU6050_get_step();
 
 void MPU6050_set_step(unsigned long count);
 
+void MPU6050_set_tap_callback(void (*callback)());
+
+void MPU6050_set_raise_callback(void (*callback)(int64_t time));
+
 #endif
\ No newline at end of file
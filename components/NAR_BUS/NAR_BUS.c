@@ -0,0 +1,152 @@
+/**
+ * @file NAR_BUS.c
+ * @brief timestamped sample bus, lets sensor drivers share time-aligned data
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "NAR_BUS.h"
+#include "freertos/FreeRTOS.h"
+#include "string.h"
+
+// 640 ms of history at 100 Hz, power of 2. Leaves slack for a streaming
+// reader that blocks on the network now and then
+#define RING_LENGTH (64)
+
+static struct {
+    NAR_BUS_sample_t ring[RING_LENGTH];
+    uint32_t head;  // total samples pushed
+    int32_t scale;  // LSB per unit, 0 - unknown
+    uint8_t users;
+} channels[NAR_BUS_CHANNELS];
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief producers only sample a channel while someone requests it
+ * @param[in] on_off
+ * | 1 - request
+ * | 0 - release
+ */
+void NAR_BUS_request(uint8_t channel, uint8_t on_off) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return;
+    }
+    portENTER_CRITICAL(&lock);
+    if (on_off) {
+        channels[channel].users++;
+    } else if (channels[channel].users) {
+        channels[channel].users--;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+/**
+ * @return 1 if anyone requests this channel
+ */
+uint8_t NAR_BUS_requested(uint8_t channel) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return 0;
+    }
+    return channels[channel].users != 0;
+}
+
+/**
+ * @brief the producer tells consumers what its raw values mean
+ * @param[in] per_unit LSB per unit of the channel, e.g. per g for
+ * NAR_BUS_ACCEL
+ */
+void NAR_BUS_set_scale(uint8_t channel, int32_t per_unit) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return;
+    }
+    channels[channel].scale = per_unit;
+}
+
+/**
+ * @return LSB per unit
+ * | 0 - unknown, the producer never set it
+ */
+int32_t NAR_BUS_get_scale(uint8_t channel) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return 0;
+    }
+    return channels[channel].scale;
+}
+
+/**
+ * @param[in] time when the sample was taken, us
+ */
+void NAR_BUS_push(uint8_t channel, int64_t time, const int32_t value[3]) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return;
+    }
+    portENTER_CRITICAL(&lock);
+    NAR_BUS_sample_t* p =
+        &channels[channel].ring[channels[channel].head % RING_LENGTH];
+    p->time = time;
+    memcpy(p->value, value, sizeof(p->value));
+    channels[channel].head++;
+    portEXIT_CRITICAL(&lock);
+}
+
+/**
+ * @brief find the sample taken closest to time
+ * @param[out] sample NonNull
+ * @return 1 if found
+ */
+uint8_t NAR_BUS_nearest(uint8_t channel,
+                        int64_t time,
+                        NAR_BUS_sample_t* sample) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return 0;
+    }
+    uint8_t found = 0;
+    int64_t best = INT64_MAX;
+    portENTER_CRITICAL(&lock);
+    uint32_t head = channels[channel].head;
+    uint32_t count = head < RING_LENGTH ? head : RING_LENGTH;
+    // newest first, stop once samples get further away
+    for (uint32_t i = 1; i <= count; i++) {
+        NAR_BUS_sample_t* p = &channels[channel].ring[(head - i) % RING_LENGTH];
+        int64_t diff = p->time > time ? p->time - time : time - p->time;
+        if (diff > best) {
+            break;
+        }
+        best = diff;
+        *sample = *p;
+        found = 1;
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
+
+/**
+ * @brief read the samples pushed after *cursor, oldest first. A reader more
+ * than RING_LENGTH samples behind loses the oldest ones.
+ * @param[in,out] cursor NonNull, samples pushed so far as seen by the reader
+ * @param[out] samples NonNull, room for max samples
+ * @return number of samples read
+ */
+uint32_t NAR_BUS_read(uint8_t channel,
+                      uint32_t* cursor,
+                      NAR_BUS_sample_t* samples,
+                      uint32_t max) {
+    if (channel >= NAR_BUS_CHANNELS) {
+        return 0;
+    }
+    portENTER_CRITICAL(&lock);
+    uint32_t head = channels[channel].head;
+    if (head - *cursor > RING_LENGTH) {
+        *cursor = head - RING_LENGTH;
+    }
+    uint32_t count = head - *cursor;
+    if (count > max) {
+        count = max;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        samples[i] = channels[channel].ring[(*cursor + i) % RING_LENGTH];
+    }
+    *cursor += count;
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file NAR_BUS.h
+ * @brief timestamped sample bus, lets sensor drivers share time-aligned data
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_BUS
+#define NARUKARA_BUS
+
+#include "esp_types.h"
+
+#define NAR_BUS_PPG (0)
+#define NAR_BUS_ACCEL (1)
+#define NAR_BUS_CHANNELS (2)
+
+typedef struct {
+    int64_t time;  // us, esp_timer_get_time()
+    int32_t value[3];
+} NAR_BUS_sample_t;
+
+void NAR_BUS_request(uint8_t channel, uint8_t on_off);
+
+uint8_t NAR_BUS_requested(uint8_t channel);
+
+void NAR_BUS_set_scale(uint8_t channel, int32_t per_unit);
+
+int32_t NAR_BUS_get_scale(uint8_t channel);
+
+void NAR_BUS_push(uint8_t channel, int64_t time, const int32_t value[3]);
+
+uint8_t NAR_BUS_nearest(uint8_t channel,
+                        int64_t time,
+                        NAR_BUS_sample_t* sample);
+
+uint32_t NAR_BUS_read(uint8_t channel,
+                      uint32_t* cursor,
+                      NAR_BUS_sample_t* samples,
+                      uint32_t max);
+
+#endif
@@ -0,0 +1,224 @@
+/**
+ * @file NAR_CONFIG.c
+ * @brief runtime settings of the band, set by key=value commands and kept
+ * in NVS
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "NAR_CONFIG.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+static const char* TAG = "NAR_CONFIG";
+
+static enum { ready, running, error } status = ready;
+
+#define fuse()                                 \
+    ({                                         \
+        status = error;                        \
+        ESP_LOGE(TAG, "fuse at %d", __LINE__); \
+    })
+
+// bump when NAR_CONFIG_t changes, older blobs are ignored
+#define CONFIG_VERSION (1)
+#define COMMAND_MAX (128)
+
+static NAR_CONFIG_t config;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static nvs_handle_t nvs = 0;
+static void (*change_callback)() = NULL;
+
+typedef struct {
+    uint8_t version;
+    NAR_CONFIG_t config;
+} stored_t;
+
+/**
+ * @brief whole number in [min, max]
+ * @return 1 if valid
+ */
+static uint8_t parse_uint(const char* value,
+                          uint32_t min,
+                          uint32_t max,
+                          uint32_t* out) {
+    char* end;
+    unsigned long v = strtoul(value, &end, 10);
+    if (end == value || *end || *value == '-' || v < min || v > max) {
+        return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+/**
+ * @brief one of two words, the first maps to 0
+ * @return 1 if valid
+ */
+static uint8_t parse_choice(const char* value,
+                            const char* no,
+                            const char* yes,
+                            uint8_t* out) {
+    if (strcmp(value, no) == 0) {
+        *out = 0;
+    } else if (strcmp(value, yes) == 0) {
+        *out = 1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief set one key of config from its text value
+ * @return 1 if key and value are valid
+ */
+static uint8_t parse_pair(const char* key,
+                          const char* value,
+                          NAR_CONFIG_t* next) {
+    uint32_t v;
+    if (strcmp(key, "period") == 0) {
+        if (!parse_uint(value, 1, 600, &v)) {
+            return 0;
+        }
+        next->period_s = v;
+    } else if (strcmp(key, "duty") == 0) {
+        if (!parse_uint(value, 0, 1440, &v)) {
+            return 0;
+        }
+        next->duty_min = v;
+    } else if (strcmp(key, "hr") == 0) {
+        return parse_choice(value, "single", "dual", &next->dual_hr);
+    } else if (strcmp(key, "fever") == 0) {
+        char* end;
+        double t = strtod(value, &end);
+        if (end == value || *end || t < 35 || t > 42) {
+            return 0;
+        }
+        next->fever = t * 100 + 0.5;
+    } else if (strcmp(key, "sit") == 0) {
+        if (!parse_uint(value, 0, 240, &v)) {
+            return 0;
+        }
+        next->sit_min = v;
+    } else if (strcmp(key, "stream") == 0) {
+        return parse_choice(value, "off", "on", &next->stream);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void save(const NAR_CONFIG_t* saved) {
+    stored_t stored = {.version = CONFIG_VERSION, .config = *saved};
+    stored.config.stream = 0;
+    if (nvs_set_blob(nvs, "config", &stored, sizeof(stored)) != ESP_OK ||
+        nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "not saved");
+    }
+}
+
+/**
+ * @brief load the saved settings, or start from defaults. Needs
+ * nvs_flash_init(), NAR_MQTT_init() does that.
+ */
+void NAR_CONFIG_init(const NAR_CONFIG_t* defaults) {
+    if (status != ready) {
+        return;
+    }
+    config = *defaults;
+    if (nvs_open("config", NVS_READWRITE, &nvs) != ESP_OK) {
+        fuse();
+        return;
+    }
+    stored_t stored;
+    size_t size = sizeof(stored);
+    if (nvs_get_blob(nvs, "config", &stored, &size) == ESP_OK &&
+        size == sizeof(stored) && stored.version == CONFIG_VERSION) {
+        config = stored.config;
+        config.stream = 0;
+        ESP_LOGI(TAG, "loaded");
+    }
+    status = running;
+}
+
+/**
+ * @param[out] out a consistent copy, never half of an update
+ */
+void NAR_CONFIG_get(NAR_CONFIG_t* out) {
+    portENTER_CRITICAL(&lock);
+    *out = config;
+    portEXIT_CRITICAL(&lock);
+}
+
+/**
+ * @brief parse "key=value key=value ...", separated by space, ';', ',' or
+ * newline. Either every pair is valid and all of them take effect at once,
+ * or nothing changes.
+ * @param[out] reply Nullable, "ok" or the first bad pair
+ * @return 1 if applied
+ */
+uint8_t NAR_CONFIG_apply(const char* command,
+                         int len,
+                         char* reply,
+                         size_t size) {
+    if (status != running) {
+        return 0;
+    }
+    char text[COMMAND_MAX];
+    if (len <= 0 || len >= COMMAND_MAX) {
+        if (reply) {
+            snprintf(reply, size, "error: length");
+        }
+        return 0;
+    }
+    memcpy(text, command, len);
+    text[len] = 0;
+    NAR_CONFIG_t next;
+    NAR_CONFIG_get(&next);
+    char* save_ptr;
+    uint8_t pairs = 0;
+    for (char* pair = strtok_r(text, " ;,\r\n", &save_ptr); pair;
+         pair = strtok_r(NULL, " ;,\r\n", &save_ptr)) {
+        char* value = strchr(pair, '=');
+        if (value) {
+            *value++ = 0;
+        }
+        if (!value || !parse_pair(pair, value, &next)) {
+            if (reply) {
+                snprintf(reply, size, "error: %s", pair);
+            }
+            return 0;
+        }
+        pairs++;
+    }
+    if (pairs == 0) {
+        if (reply) {
+            snprintf(reply, size, "error: empty");
+        }
+        return 0;
+    }
+    portENTER_CRITICAL(&lock);
+    config = next;
+    portEXIT_CRITICAL(&lock);
+    save(&next);
+    if (reply) {
+        snprintf(reply, size, "ok");
+    }
+    if (change_callback) {
+        change_callback();
+    }
+    return 1;
+}
+
+/**
+ * @brief callback runs in the caller of NAR_CONFIG_apply() after a change,
+ * fetch the new settings with NAR_CONFIG_get()
+ * @param[in] callback Nullable
+ */
+void NAR_CONFIG_set_callback(void (*callback)()) {
+    change_callback = callback;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+/**
+ * @file NAR_CONFIG.h
+ * @brief runtime settings of the band, set by key=value commands and kept
+ * in NVS
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_CONFIG
+#define NARUKARA_CONFIG
+
+#include "esp_types.h"
+
+typedef struct {
+    uint32_t period_s;  // period=1..600, sensor reading interval
+    uint16_t duty_min;  // duty=0..1440, radio duty cycle, 0 - off
+    uint8_t dual_hr;    // hr=single|dual, acquisition profile
+    uint16_t fever;     // fever=35.00..42.00, alarm threshold, 0.01 degree
+    uint8_t sit_min;    // sit=0..240, long sit alarm, 0 - off
+    uint8_t stream;     // stream=on|off, raw streaming, not persisted
+} NAR_CONFIG_t;
+
+void NAR_CONFIG_init(const NAR_CONFIG_t* defaults);
+
+void NAR_CONFIG_get(NAR_CONFIG_t* config);
+
+uint8_t NAR_CONFIG_apply(const char* command,
+                         int len,
+                         char* reply,
+                         size_t size);
+
+void NAR_CONFIG_set_callback(void (*callback)());
+
+#endif
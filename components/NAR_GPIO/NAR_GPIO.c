@@ -7,6 +7,9 @@
  */
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #define IO0 (0)
 #define LED (2)
@@ -17,6 +20,10 @@ static const char* TAG = "NAR_GPIO";
 
 static uint8_t IO0_flag = 0;
 static uint8_t IO0_double_flag = 0;
+static void (*IO0_callback)() = NULL;
+
+static SemaphoreHandle_t MAX30102_intr_sem = NULL;
+static volatile int64_t MAX30102_intr_time = 0;
 
 static enum { ready, running, error } status = ready;
 
@@ -36,6 +43,18 @@ static void IO0_isr(void* arg) {
     } else {
         IO0_flag = 1;
     }
+    if (IO0_callback) {
+        IO0_callback();
+    }
+}
+
+/**
+ * @brief callback runs in ISR context on every press, it must be short and
+ * only use FromISR APIs
+ * @param[in] callback Nullable
+ */
+void NAR_GPIO_set_IO0_callback(void (*callback)()) {
+    IO0_callback = callback;
 }
 
 uint8_t NAR_GPIO_get_IO0_flag() {
@@ -87,6 +106,44 @@ int NAR_GPIO_get_MAX30102_intr() {
     return gpio_get_level(MAX30102_INTR);
 }
 
+/**
+ * @brief interrupt service function for MAX30102 interrupt, timestamps the
+ * falling edge
+ */
+static void MAX30102_intr_isr(void* arg) {
+    MAX30102_intr_time = esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(MAX30102_intr_sem, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * @brief block until MAX30102 interrupt is asserted, instead of spinning on
+ * NAR_GPIO_get_MAX30102_intr
+ * @param[in] timeout_ms
+ * @param[out] time Nullable, time of the falling edge, us
+ * @return 1 if asserted, 0 if timeout
+ */
+uint8_t NAR_GPIO_wait_MAX30102_intr(uint32_t timeout_ms, int64_t* time) {
+    if (status != running) {
+        return 0;
+    }
+    TickType_t ticks = timeout_ms / portTICK_PERIOD_MS + 1;
+    while (gpio_get_level(MAX30102_INTR)) {
+        if (xSemaphoreTake(MAX30102_intr_sem, ticks) != pdTRUE) {
+            return 0;
+        }
+    }
+    // already low, drop the give of this edge
+    xSemaphoreTake(MAX30102_intr_sem, 0);
+    if (time) {
+        *time = MAX30102_intr_time;
+    }
+    return 1;
+}
+
 void NAR_GPIO_init() {
     if (status != ready) {
         return;
@@ -95,7 +152,19 @@ void NAR_GPIO_init() {
     gpio_set_level(BUZ, 1);
     gpio_set_direction(LED, GPIO_MODE_OUTPUT);
     gpio_set_level(LED, 0);
-    gpio_set_direction(MAX30102_INTR, GPIO_MODE_INPUT);
+    MAX30102_intr_sem = xSemaphoreCreateBinary();
+    if (!MAX30102_intr_sem) {
+        fuse();
+        return;
+    }
+    gpio_config_t intr_config = {
+        .intr_type = GPIO_PIN_INTR_NEGEDGE,  // active low
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .pin_bit_mask = (1ULL << MAX30102_INTR),
+    };
+    gpio_config(&intr_config);
     gpio_config_t config = {
         .intr_type = GPIO_PIN_INTR_POSEDGE,  // positive edge
         .mode = GPIO_MODE_INPUT,
@@ -106,6 +175,7 @@ void NAR_GPIO_init() {
     gpio_config(&config);
     gpio_install_isr_service(0);
     gpio_isr_handler_add(IO0, IO0_isr, NULL);
+    gpio_isr_handler_add(MAX30102_INTR, MAX30102_intr_isr, NULL);
     status = running;
     ESP_LOGI(TAG, "GPIO init");
 }
\ No newline at end of file
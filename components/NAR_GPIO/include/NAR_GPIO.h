@@ -20,10 +20,14 @@ uint8_t NAR_GPIO_get_IO0_double_flag();
 
 void NAR_GPIO_clear_IO0_double_flag();
 
+void NAR_GPIO_set_IO0_callback(void (*callback)());
+
 void NAR_GPIO_set_BUZ(uint8_t on_off);
 
 void NAR_GPIO_set_LED(uint8_t on_off);
 
 int NAR_GPIO_get_MAX30102_intr();
 
+uint8_t NAR_GPIO_wait_MAX30102_intr(uint32_t timeout_ms, int64_t* time);
+
 #endif
\ No newline at end of file
@@ -72,6 +72,26 @@ void i2c_init() {
     ESP_LOGI(TAG, "i2c init");
 }
 
+/**
+ * @brief change SCL frequency of I2C_PORT, every device on it must support it
+ * @param[in] freq in Hz, SSD1306 / MAX30102 / MPU6050 all accept <= 400000
+ * @return ESP_OK if successful
+ */
+esp_err_t i2c_set_freq(uint32_t freq) {
+    if (status != running) {
+        return ESP_FAIL;
+    }
+    i2c_config_t config = {
+        .mode = I2C_MODE_MASTER,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = SCL,
+        .sda_io_num = SDA,
+        .master.clk_speed = freq,
+    };
+    return i2c_param_config(I2C_PORT, &config);
+}
+
 /**
  * @param[in] size size of data, 0 is OK
  * @param[in] data Nullable
@@ -11,6 +11,8 @@
 
 void i2c_init();
 
+esp_err_t i2c_set_freq(uint32_t freq);
+
 esp_err_t i2c_write(uint8_t slave_addr,
                     uint8_t reg_addr,
                     size_t size,
@@ -4,11 +4,20 @@
  * @author Narukara
  * @date 2021.2
  */
+#include "NAR_MQTT.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
 #include "mqtt_client.h"
 #include "nvs_flash.h"
-#include "protocol_examples_common.h"
+#include "sdkconfig.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
 
 static const char* TAG = "NAR_MQTT";
 
@@ -20,8 +29,204 @@ static enum { ready, running, error } status = ready;
         ESP_LOGE(TAG, "fuse at %d", __LINE__); \
     })
 
-static uint8_t connected = 0;
+// delivery policy of each stream
+static const struct {
+    uint8_t qos;
+    uint8_t retain;
+} policy[NAR_MQTT_STREAMS] = {
+    [NAR_MQTT_LIVE] = {0, 0},
+    [NAR_MQTT_ALERT] = {1, 0},
+    [NAR_MQTT_BATCH] = {1, 0},
+    [NAR_MQTT_LAST] = {0, 1},
+    [NAR_MQTT_STATUS] = {1, 1},
+    [NAR_MQTT_REPLY] = {1, 0},
+};
+
+// wifi reconnect delay doubles per failure, up to BACKOFF_MAX_MS
+#define BACKOFF_MIN_MS (1000)
+#define BACKOFF_MAX_MS (60000)
+
+// esp-mqtt resends an unacked QoS 1 publish after this
+#define RETRANSMIT_MS (1000)
+// in flight QoS 1 publishes followed to their PUBACK
+#define TRACK_LENGTH (16)
+// esp-mqtt expires outbox entries after 30 s, give up on a PUBACK after
+// twice that
+#define TRACK_EXPIRE_US (60000000LL)
+
+// upper edges of the PUBACK latency histogram, ms, the last bucket is open
+static const uint32_t latency_edges[] = {20,  50,   100,  200,   500,
+                                         1000, 2000, 5000, 10000, 30000};
+#define LATENCY_BUCKETS (sizeof(latency_edges) / sizeof(latency_edges[0]) + 1)
+
+static struct {
+    int msg_id;  // 0 - free
+    int64_t time;
+} track[TRACK_LENGTH];
+static uint32_t latency_histogram[LATENCY_BUCKETS];
+static NAR_MQTT_pub_stats_t pub_stats;
+static portMUX_TYPE pub_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// eFuse base MAC in hex, the client id is "band-" and the same
+static char device_id[13] = "";
+static char client_id[18] = "";
+
+static volatile NAR_MQTT_state_t state = NAR_MQTT_OFF;
+static uint8_t wanted = 0;  // between NAR_MQTT_start() and NAR_MQTT_end()
+static uint8_t client_started = 0;
 static esp_mqtt_client_handle_t client = NULL;
+static esp_timer_handle_t retry_timer = NULL;
+static uint32_t backoff_ms = BACKOFF_MIN_MS;
+static int64_t down_since = 0;  // start request or link loss
+static uint8_t first_connect = 0;
+static NAR_MQTT_stats_t stats;
+static int64_t radio_on_us = 0;  // finished radio on periods
+static int64_t radio_on_since = 0;
+static portMUX_TYPE radio_lock = portMUX_INITIALIZER_UNLOCKED;
+static const char* status_topic = NULL;
+static void (*state_callback)(NAR_MQTT_state_t state) = NULL;
+static void (*published_callback)(int msg_id) = NULL;
+static const char* command_topic = NULL;
+static void (*command_callback)(const char* data, int len) = NULL;
+
+static void set_state(NAR_MQTT_state_t new_state) {
+    if (state == new_state) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (state == NAR_MQTT_CONNECTED && wanted) {
+        down_since = now;
+    }
+    portENTER_CRITICAL(&radio_lock);
+    if (state == NAR_MQTT_OFF) {
+        radio_on_since = now;
+    } else if (new_state == NAR_MQTT_OFF) {
+        radio_on_us += now - radio_on_since;
+    }
+    state = new_state;
+    portEXIT_CRITICAL(&radio_lock);
+    if (state_callback) {
+        state_callback(new_state);
+    }
+}
+
+static void count_connect() {
+    uint32_t ms = (esp_timer_get_time() - down_since) / 1000;
+    stats.connects++;
+    if (!first_connect) {
+        stats.reconnects++;
+    }
+    first_connect = 0;
+    stats.last_latency_ms = ms;
+    stats.total_latency_ms += ms;
+    if (ms > stats.max_latency_ms) {
+        stats.max_latency_ms = ms;
+    }
+    ESP_LOGI(TAG, "connected in %u ms, %u reconnects, %u wifi retries", ms,
+             stats.reconnects, stats.wifi_retries);
+}
+
+/**
+ * @brief called with pub_lock held, entries that waited too long count as
+ * dropped
+ */
+static void track_expire(int64_t now) {
+    for (int i = 0; i < TRACK_LENGTH; i++) {
+        if (track[i].msg_id && now - track[i].time > TRACK_EXPIRE_US) {
+            track[i].msg_id = 0;
+            pub_stats.inflight--;
+            pub_stats.dropped++;
+        }
+    }
+}
+
+static void track_add(int msg_id, int64_t time) {
+    portENTER_CRITICAL(&pub_lock);
+    track_expire(time);
+    int slot = 0;
+    for (int i = 0; i < TRACK_LENGTH; i++) {
+        if (track[i].msg_id == 0) {
+            slot = i;
+            break;
+        }
+        if (track[i].time < track[slot].time) {
+            slot = i;
+        }
+    }
+    if (track[slot].msg_id) {
+        // full, the oldest one has no PUBACK while 16 newer were queued
+        pub_stats.inflight--;
+        pub_stats.dropped++;
+    }
+    track[slot].msg_id = msg_id;
+    track[slot].time = time;
+    pub_stats.inflight++;
+    portEXIT_CRITICAL(&pub_lock);
+}
+
+/**
+ * @return us since the publish was queued
+ * | -1 - not followed, QoS 0 or already expired
+ */
+static int64_t track_remove(int msg_id) {
+    int64_t waited = -1;
+    portENTER_CRITICAL(&pub_lock);
+    for (int i = 0; i < TRACK_LENGTH; i++) {
+        if (track[i].msg_id == msg_id) {
+            track[i].msg_id = 0;
+            pub_stats.inflight--;
+            waited = esp_timer_get_time() - track[i].time;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pub_lock);
+    return waited;
+}
+
+static void count_acked(int msg_id) {
+    int64_t waited = track_remove(msg_id);
+    if (waited < 0) {
+        return;
+    }
+    uint32_t ms = waited / 1000;
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && ms > latency_edges[bucket]) {
+        bucket++;
+    }
+    portENTER_CRITICAL(&pub_lock);
+    latency_histogram[bucket]++;
+    pub_stats.acked++;
+    pub_stats.retransmits += ms / RETRANSMIT_MS;
+    if (ms > pub_stats.max_ms) {
+        pub_stats.max_ms = ms;
+    }
+    portEXIT_CRITICAL(&pub_lock);
+}
+
+static void count_deleted(int msg_id) {
+    if (track_remove(msg_id) < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&pub_lock);
+    pub_stats.dropped++;
+    portEXIT_CRITICAL(&pub_lock);
+}
+
+/**
+ * @brief called with pub_lock held
+ * @param[in] per_mille 500 for the median
+ */
+static uint32_t percentile(uint32_t per_mille) {
+    uint64_t rank = ((uint64_t)pub_stats.acked * per_mille + 999) / 1000;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += latency_histogram[i];
+        if (seen >= rank) {
+            return latency_edges[i];
+        }
+    }
+    return pub_stats.max_ms;
+}
 
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
     esp_mqtt_client_handle_t client = event->client;
@@ -29,12 +234,24 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            connected = 1;
-            esp_mqtt_client_subscribe(client, "/esp32/sub", 1);
+            count_connect();
+            set_state(NAR_MQTT_CONNECTED);
+            if (status_topic) {
+                // replaces the retained "offline" will
+                esp_mqtt_client_publish(client, status_topic, "online", 0,
+                                        policy[NAR_MQTT_STATUS].qos,
+                                        policy[NAR_MQTT_STATUS].retain);
+            }
+            if (command_topic) {
+                esp_mqtt_client_subscribe(client, command_topic, 1);
+            }
             break;
 
         case MQTT_EVENT_DISCONNECTED:
-            connected = 0;
+            // the client retries the broker by itself while wifi is up
+            if (state == NAR_MQTT_CONNECTED) {
+                set_state(NAR_MQTT_BROKER);
+            }
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
             break;
 
@@ -47,13 +264,29 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
             break;
 
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+            count_acked(event->msg_id);
+            if (published_callback) {
+                published_callback(event->msg_id);
+            }
+            break;
+
+        case MQTT_EVENT_DELETED:
+            // expired in the outbox, never acked
+            ESP_LOGW(TAG, "MQTT_EVENT_DELETED, msg_id=%d", event->msg_id);
+            count_deleted(event->msg_id);
             break;
 
         case MQTT_EVENT_DATA:
-            ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-            printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-            printf("DATA=%.*s\r\n", event->data_len, event->data);
+            // commands can carry anything, only at debug level
+            ESP_LOGD(TAG, "MQTT_EVENT_DATA, topic=%.*s data=%.*s",
+                     event->topic_len, event->topic, event->data_len,
+                     event->data);
+            if (command_callback && command_topic &&
+                event->topic_len == strlen(command_topic) &&
+                memcmp(event->topic, command_topic, event->topic_len) == 0) {
+                command_callback(event->data, event->data_len);
+            }
             break;
 
         case MQTT_EVENT_ERROR:
@@ -88,25 +321,81 @@ static void mqtt_event_handler(void* handler_args,
     mqtt_event_handler_cb(event_data);
 }
 
+/**
+ * @brief the client is created once and kept, later starts reuse it
+ */
 static void mqtt_app_start(void) {
     if (client == NULL) {
         const esp_mqtt_client_config_t mqtt_cfg = {
         .uri = "mqtts://49.235.143.220:1883",
         .cert_pem = (const char *)"-----BEGIN CERTIFICATE-----\nMIIDyzCCArOgAwIBAgIJAMtNfJ3gcyScMA0GCSqGSIb3DQEBCwUAMHwxCzAJBgNVBAYTAkNOMRAwDgYDVQQIDAdCZWlKaW5nMRAwDgYDVQQHDAdCZWlKaW5nMREwDwYDVQQKDAhNZWRpY2luZTERMA8GA1UEAwwITmFydWthcmExIzAhBgkqhkiG9w0BCQEWFGh1cnVpMjE3QGZveG1haWwuY29tMB4XDTIwMTAyNDE1NTEzNFoXDTMwMTAyMjE1NTEzNFowfDELMAkGA1UEBhMCQ04xEDAOBgNVBAgMB0JlaUppbmcxEDAOBgNVBAcMB0JlaUppbmcxETAPBgNVBAoMCE1lZGljaW5lMREwDwYDVQQDDAhOYXJ1a2FyYTEjMCEGCSqGSIb3DQEJARYUaHVydWkyMTdAZm94bWFpbC5jb20wggEiMA0GCSqGSIb3DQEBAQUAA4IBDwAwggEKAoIBAQDGat1oSjNXLUEdLO30B/a1cszVK6Hl2IOtVm5EHJtcbzoHFUrBcMPRbvwf8NAF7H23w4q+ZaWwhmZALZOdO2mp7/e7gIIqmXGB6bD6tD+fQtlRe2yJqXLHtx81blv4/VQUUdlHgO0o7OlQl0tylFP+CjCMHUq+gmj/pg0TcnRC39tiQf1rqio0URdhktMedGgBkC4g4ZWHYm/k06MhoHsFqa2heizRmPGfYBdHlYCwSgF2lduR7ea2xwg8GTm7NRbspt1j4orjTcbeiR7egm0WKGlD4y5U7UW3QisKSYuNBhD81aVO2IXx8G/rgQgqnuAX/F+TfR0VMuE76x+/GV49AgMBAAGjUDBOMB0GA1UdDgQWBBS/4YpWTMEb8ztB4yUQLrZKI8IgNDAfBgNVHSMEGDAWgBS/4YpWTMEb8ztB4yUQLrZKI8IgNDAMBgNVHRMEBTADAQH/MA0GCSqGSIb3DQEBCwUAA4IBAQA2YgY1UgIXwiA0Q38jjUaZbGPNXlYi1leSVBT1swdSpWuPp1Nfhp/V95RUDq830fi5xGZbJ/yFZgNtYv8MwtoFkpRWbIMuQQS7jSzAP0u5X9u0+xpPFzqrn0pzevemtti5YOeVH748o87yjWgfij+90NyvNEbhETHZiA/aN0ncHluY/eVWp70ZqeKCvbBlXM5zJHxjmFvjCmfoG5KyZFsdf0WyxpRsFvK9m1B8N+S5l8XMaxt7M1jkTWVQbso3Db8nzd1H8ylSZLmuTxE/u393egCL/z0s3hiLq+0YiigyTWYM1JQD79dnwDlF8iW0FUwdusKvrSPCW1vrKRtnxIPI\n-----END CERTIFICATE-----",
-        .username = "esp32",
+        .client_id = client_id,
+        // per device, so the broker can tell bands apart and lock one out
+        .username = client_id,
         .password = "esp32",
+        // the broker marks the band offline if it vanishes without a word
+        .lwt_topic = status_topic,
+        .lwt_msg = "offline",
+        .lwt_qos = policy[NAR_MQTT_STATUS].qos,
+        .lwt_retain = policy[NAR_MQTT_STATUS].retain,
+        .message_retransmit_timeout = RETRANSMIT_MS,
         };
         client = esp_mqtt_client_init(&mqtt_cfg);
         esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID,
                                        mqtt_event_handler, client);
     }
-    esp_mqtt_client_start(client);
+    if (esp_mqtt_client_start(client) == ESP_OK) {
+        client_started = 1;
+    }
+}
+
+static void retry_cb(void* arg) {
+    if (wanted) {
+        esp_wifi_connect();
+    }
+}
+
+/**
+ * @brief runs in the default event loop task, drives wifi from STA_START to
+ * an address and hands over to the MQTT client
+ */
+static void wifi_event_handler(void* handler_args,
+                               esp_event_base_t base,
+                               int32_t event_id,
+                               void* event_data) {
+    if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (base == WIFI_EVENT &&
+               event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (!wanted) {
+            return;
+        }
+        set_state(NAR_MQTT_WIFI);
+        stats.wifi_retries++;
+        ESP_LOGI(TAG, "wifi lost, retry in %u ms", backoff_ms);
+        esp_timer_start_once(retry_timer, backoff_ms * 1000LL);
+        backoff_ms = backoff_ms * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS
+                                                     : backoff_ms * 2;
+    } else if (base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        if (!wanted) {
+            return;
+        }
+        backoff_ms = BACKOFF_MIN_MS;
+        set_state(NAR_MQTT_BROKER);
+        if (!client_started) {
+            mqtt_app_start();
+        }
+    }
 }
 
 void NAR_MQTT_init() {
     if (status != ready) {
         return;
     }
+    if (NAR_MQTT_get_device_id()[0] == 0) {
+        fuse();
+        return;
+    }
     if (nvs_flash_init() != ESP_OK) {
         fuse();
         return;
@@ -119,41 +408,247 @@ void NAR_MQTT_init() {
         fuse();
         return;
     }
+    esp_netif_create_default_wifi_sta();
+    wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+    if (esp_wifi_init(&init) != ESP_OK) {
+        fuse();
+        return;
+    }
+    // same ssid / password settings example_connect() used
+    wifi_config_t wifi = {
+        .sta =
+            {
+                .ssid = CONFIG_EXAMPLE_WIFI_SSID,
+                .password = CONFIG_EXAMPLE_WIFI_PASSWORD,
+            },
+    };
+    if (esp_wifi_set_storage(WIFI_STORAGE_RAM) != ESP_OK ||
+        esp_wifi_set_mode(WIFI_MODE_STA) != ESP_OK ||
+        esp_wifi_set_config(WIFI_IF_STA, &wifi) != ESP_OK) {
+        fuse();
+        return;
+    }
+    if (esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                   wifi_event_handler, NULL) != ESP_OK ||
+        esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
+                                   wifi_event_handler, NULL) != ESP_OK) {
+        fuse();
+        return;
+    }
+    esp_timer_create_args_t retry_args = {
+        .callback = retry_cb,
+        .name = "wifi retry",
+    };
+    if (esp_timer_create(&retry_args, &retry_timer) != ESP_OK) {
+        fuse();
+        return;
+    }
     status = running;
     ESP_LOGI(TAG, "mqtt init");
 }
 
+/**
+ * @return 12 hex digits of the eFuse base MAC, the same on every boot
+ * | "" - MAC not readable
+ */
+const char* NAR_MQTT_get_device_id() {
+    if (device_id[0] == 0) {
+        uint8_t mac[6];
+        if (esp_efuse_mac_get_default(mac) != ESP_OK) {
+            return device_id;
+        }
+        snprintf(device_id, sizeof(device_id), "%02x%02x%02x%02x%02x%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        snprintf(client_id, sizeof(client_id), "band-%s", device_id);
+    }
+    return device_id;
+}
+
+/**
+ * @brief build a topic of this band, e.g. "batch" -> "band/<device id>/batch"
+ * @return never freed, call once per topic at init
+ * | NULL - no device id, or no memory
+ */
+const char* NAR_MQTT_topic(const char* leaf) {
+    const char* id = NAR_MQTT_get_device_id();
+    if (id[0] == 0) {
+        return NULL;
+    }
+    size_t size = strlen(NAR_MQTT_TOPIC_ROOT) + strlen(id) + strlen(leaf) + 3;
+    char* topic = malloc(size);
+    if (topic) {
+        snprintf(topic, size, NAR_MQTT_TOPIC_ROOT "/%s/%s", id, leaf);
+    }
+    return topic;
+}
+
+/**
+ * @brief returns at once, wifi and the broker connect in the background and
+ * keep retrying until NAR_MQTT_end()
+ */
 void NAR_MQTT_start() {
-    if (status != running || connected) {
+    if (status != running || wanted) {
         return;
     }
-    if (example_connect() != ESP_OK) {
+    wanted = 1;
+    first_connect = 1;
+    backoff_ms = BACKOFF_MIN_MS;
+    down_since = esp_timer_get_time();
+    set_state(NAR_MQTT_WIFI);
+    if (esp_wifi_start() != ESP_OK) {
         fuse();
         return;
     }
-    mqtt_app_start();
+    // between DTIM beacons the modem sleeps while the link stays up
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
 }
 
+/**
+ * @brief stop the client and switch the radio off, the client is kept
+ */
 void NAR_MQTT_end() {
-    if (status != running || !connected) {
+    if (status != running || !wanted) {
         return;
     }
-    if (esp_mqtt_client_stop(client) != ESP_OK) {
-        fuse();
+    wanted = 0;
+    esp_timer_stop(retry_timer);
+    if (client_started) {
+        if (status_topic && state == NAR_MQTT_CONNECTED) {
+            // a clean stop does not fire the will, and nobody waits for a
+            // PUBACK here
+            esp_mqtt_client_publish(client, status_topic, "offline", 0, 0,
+                                    policy[NAR_MQTT_STATUS].retain);
+        }
+        if (esp_mqtt_client_stop(client) != ESP_OK) {
+            fuse();
+        }
+        client_started = 0;
     }
-    if (example_disconnect() != ESP_OK) {
+    if (esp_wifi_stop() != ESP_OK) {
         fuse();
     }
-    connected = 0;
+    set_state(NAR_MQTT_OFF);
+}
+
+/**
+ * @brief retained "online" / "offline" go here, "offline" also as the will.
+ * Takes effect when the client is created, call before NAR_MQTT_start().
+ * @param[in] topic must outlive the module
+ */
+void NAR_MQTT_set_status_topic(const char* topic) {
+    status_topic = topic;
+}
+
+/**
+ * @brief callback runs in the MQTT or event loop task on every state change
+ * @param[in] callback Nullable
+ */
+void NAR_MQTT_set_state_callback(void (*callback)(NAR_MQTT_state_t state)) {
+    state_callback = callback;
+}
+
+NAR_MQTT_state_t NAR_MQTT_get_state() {
+    return state;
+}
+
+/**
+ * @return us the radio was on since boot, from NAR_MQTT_start() to
+ * NAR_MQTT_end()
+ */
+int64_t NAR_MQTT_get_radio_on_time() {
+    portENTER_CRITICAL(&radio_lock);
+    int64_t on = radio_on_us;
+    if (state != NAR_MQTT_OFF) {
+        on += esp_timer_get_time() - radio_on_since;
+    }
+    portEXIT_CRITICAL(&radio_lock);
+    return on;
+}
+
+/**
+ * @param[out] out connect latency and retry counters since boot
+ */
+void NAR_MQTT_get_stats(NAR_MQTT_stats_t* out) {
+    *out = stats;
+}
+
+/**
+ * @param[out] out publish counters and PUBACK latency since boot, outbox
+ * depth now
+ */
+void NAR_MQTT_get_pub_stats(NAR_MQTT_pub_stats_t* out) {
+    portENTER_CRITICAL(&pub_lock);
+    track_expire(esp_timer_get_time());
+    *out = pub_stats;
+    out->p50_ms = percentile(500);
+    out->p90_ms = percentile(900);
+    out->p99_ms = percentile(990);
+    portEXIT_CRITICAL(&pub_lock);
+    out->outbox_bytes = client ? esp_mqtt_client_get_outbox_size(client) : 0;
+}
+
+/**
+ * @brief callback runs in the MQTT task when the broker acks a QoS1 publish
+ * @param[in] callback Nullable
+ */
+void NAR_MQTT_set_published_callback(void (*callback)(int msg_id)) {
+    published_callback = callback;
+}
+
+/**
+ * @brief subscribe to topic on every connect, callback runs in the MQTT task
+ * for each message on it, data is not 0 terminated. Call before
+ * NAR_MQTT_start().
+ * @param[in] topic must outlive the module
+ * @param[in] callback Nullable
+ */
+void NAR_MQTT_set_command_callback(const char* topic,
+                                   void (*callback)(const char* data,
+                                                    int len)) {
+    command_topic = topic;
+    command_callback = callback;
 }
 
 uint8_t NAR_MQTT_get_connected() {
-    return connected;
+    return state == NAR_MQTT_CONNECTED;
 }
 
-void NAR_MQTT_pub(const char* topic, const char* data) {
-    if (status != running || connected != 1) {
-        return;
+/**
+ * @brief publish with the QoS / retain policy of the stream
+ * @return msg_id
+ * | 0 - QoS 0, sent
+ * | -1 - not connected or not queued
+ */
+int NAR_MQTT_pub(NAR_MQTT_stream_t stream,
+                 const char* topic,
+                 const char* data) {
+    return NAR_MQTT_pub_bin(stream, topic, (const uint8_t*)data, strlen(data));
+}
+
+/**
+ * @brief NAR_MQTT_pub() for a binary payload, which may contain 0
+ */
+int NAR_MQTT_pub_bin(NAR_MQTT_stream_t stream,
+                     const char* topic,
+                     const uint8_t* data,
+                     size_t len) {
+    if (status != running || state != NAR_MQTT_CONNECTED ||
+        stream >= NAR_MQTT_STREAMS || topic == NULL) {
+        return -1;
+    }
+    int64_t now = esp_timer_get_time();
+    int msg_id =
+        esp_mqtt_client_publish(client, topic, (const char*)data, len,
+                                policy[stream].qos, policy[stream].retain);
+    if (msg_id < 0) {
+        return msg_id;
+    }
+    portENTER_CRITICAL(&pub_lock);
+    pub_stats.published++;
+    pub_stats.bytes += len;
+    portEXIT_CRITICAL(&pub_lock);
+    if (msg_id > 0) {
+        track_add(msg_id, now);
     }
-    esp_mqtt_client_publish(client, topic, data, 0, 1, 0);
+    return msg_id;
 }
\ No newline at end of file
@@ -9,14 +9,89 @@
 
 #include "esp_types.h"
 
+// topics are band/<device id>/<leaf>, ingest can share the fleet out with
+// $share/<group>/band/+/<leaf> and shard by the second level
+#define NAR_MQTT_TOPIC_ROOT "band"
+
+typedef enum {
+    NAR_MQTT_OFF,     // radio off
+    NAR_MQTT_WIFI,    // associating, or waiting to retry
+    NAR_MQTT_BROKER,  // have an address, connecting to the broker
+    NAR_MQTT_CONNECTED,
+} NAR_MQTT_state_t;
+
+// each stream has its own QoS / retain policy
+typedef enum {
+    NAR_MQTT_LIVE,    // QoS 0, stale within seconds anyway
+    NAR_MQTT_ALERT,   // QoS 1
+    NAR_MQTT_BATCH,   // QoS 1
+    NAR_MQTT_LAST,    // QoS 0 retained, last value for the dashboard
+    NAR_MQTT_STATUS,  // QoS 1 retained, online / offline
+    NAR_MQTT_REPLY,   // QoS 1, answers to commands
+    NAR_MQTT_STREAMS,
+} NAR_MQTT_stream_t;
+
+typedef struct {
+    uint32_t connects;    // broker sessions
+    uint32_t reconnects;  // sessions after a link loss
+    uint32_t wifi_retries;
+    // from NAR_MQTT_start() or the link loss to the broker session, ms
+    uint32_t last_latency_ms;
+    uint32_t max_latency_ms;
+    uint32_t total_latency_ms;
+} NAR_MQTT_stats_t;
+
+// publish path since boot, QoS 1 msg_id followed from enqueue to PUBACK
+typedef struct {
+    uint32_t published;  // every stream
+    uint32_t bytes;      // payload
+    uint32_t acked;
+    // PUBACK latency, upper edge of the histogram bucket, ms
+    uint32_t p50_ms;
+    uint32_t p90_ms;
+    uint32_t p99_ms;
+    uint32_t max_ms;
+    uint32_t retransmits;  // estimated, one per retransmit timeout waited
+    uint32_t dropped;      // deleted from the outbox, or never acked
+    uint8_t inflight;      // waiting for PUBACK now
+    int outbox_bytes;      // now
+} NAR_MQTT_pub_stats_t;
+
 void NAR_MQTT_init();
 
 void NAR_MQTT_start();
 
+const char* NAR_MQTT_get_device_id();
+
+const char* NAR_MQTT_topic(const char* leaf);
+
 void NAR_MQTT_end();
 
+void NAR_MQTT_set_state_callback(void (*callback)(NAR_MQTT_state_t state));
+
+NAR_MQTT_state_t NAR_MQTT_get_state();
+
+void NAR_MQTT_get_stats(NAR_MQTT_stats_t* stats);
+
+void NAR_MQTT_get_pub_stats(NAR_MQTT_pub_stats_t* stats);
+
+int64_t NAR_MQTT_get_radio_on_time();
+
+void NAR_MQTT_set_published_callback(void (*callback)(int msg_id));
+
+void NAR_MQTT_set_command_callback(const char* topic,
+                                   void (*callback)(const char* data,
+                                                    int len));
+
 uint8_t NAR_MQTT_get_connected();
 
-void NAR_MQTT_pub(const char* topic, const char* data);
+void NAR_MQTT_set_status_topic(const char* topic);
+
+int NAR_MQTT_pub(NAR_MQTT_stream_t stream, const char* topic, const char* data);
+
+int NAR_MQTT_pub_bin(NAR_MQTT_stream_t stream,
+                     const char* topic,
+                     const uint8_t* data,
+                     size_t len);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,254 @@
+/**
+ * @file NAR_SCHED.c
+ * @brief periodic jobs, each on its own task with its own priority
+ * @author Narukara
+ * @date 2021.2
+ *
+ * An esp_timer releases a job every period, or NAR_SCHED_trigger() does,
+ * and the job's task runs it once per release. A slow job only delays the
+ * jobs below its priority, and its stats show it.
+ */
+#include "NAR_SCHED.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+static const char* TAG = "NAR_SCHED";
+
+static enum { ready, running, error } status = ready;
+
+#define fuse()                                 \
+    ({                                         \
+        status = error;                        \
+        ESP_LOGE(TAG, "fuse at %d", __LINE__); \
+    })
+
+typedef struct {
+    NAR_SCHED_job_t job;
+    TaskHandle_t task;
+    esp_timer_handle_t timer;
+    uint8_t suspended;
+    int64_t release;  // oldest release not started yet, 0 - none
+    NAR_SCHED_stats_t stats;
+} slot_t;
+
+static slot_t slots[NAR_SCHED_MAX_JOBS];
+static int count = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief called with lock held
+ * @return 1 if the task should be notified
+ */
+static uint8_t release(slot_t* slot, int64_t now) {
+    if (slot->suspended) {
+        return 0;
+    }
+    slot->stats.releases++;
+    if (slot->release) {
+        // merged into the one still waiting
+        slot->stats.overruns++;
+        return 0;
+    }
+    slot->release = now;
+    return 1;
+}
+
+static void timer_cb(void* arg) {
+    slot_t* slot = arg;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&lock);
+    uint8_t notify = release(slot, now);
+    portEXIT_CRITICAL(&lock);
+    if (notify) {
+        xTaskNotifyGive(slot->task);
+    }
+}
+
+static void job_task(void* pvParameters) {
+    slot_t* slot = pvParameters;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        // releases from here on wait for the next run
+        portENTER_CRITICAL(&lock);
+        int64_t released = slot->release;
+        slot->release = 0;
+        portEXIT_CRITICAL(&lock);
+        if (released == 0) {
+            // dropped by NAR_SCHED_suspend()
+            continue;
+        }
+        slot->job.run();
+        int64_t end = esp_timer_get_time();
+
+        uint32_t deadline_ms = slot->job.deadline_ms ? slot->job.deadline_ms
+                                                     : slot->job.period_ms;
+        uint32_t run_us = end - start;
+        uint32_t wait_us = start - released;
+        portENTER_CRITICAL(&lock);
+        NAR_SCHED_stats_t* stats = &slot->stats;
+        stats->runs++;
+        stats->last_us = run_us;
+        stats->total_us += run_us;
+        if (run_us > stats->max_us) {
+            stats->max_us = run_us;
+        }
+        if (wait_us > stats->max_wait_us) {
+            stats->max_wait_us = wait_us;
+        }
+        uint8_t missed = deadline_ms && end - released > deadline_ms * 1000LL;
+        if (missed) {
+            stats->misses++;
+        }
+        portEXIT_CRITICAL(&lock);
+        if (missed) {
+            ESP_LOGW(TAG, "%s missed its deadline, %u ms", slot->job.name,
+                     (uint32_t)((end - released) / 1000));
+        }
+    }
+}
+
+/**
+ * @brief create the task and timer of a job, it starts suspended
+ * @param[in] job copied
+ * @return id
+ * | -1 - table full or out of memory
+ */
+int NAR_SCHED_add(const NAR_SCHED_job_t* job) {
+    if (status == error || count == NAR_SCHED_MAX_JOBS || job->run == NULL) {
+        return -1;
+    }
+    slot_t* slot = &slots[count];
+    slot->job = *job;
+    slot->suspended = 1;
+    esp_timer_create_args_t args = {
+        .callback = timer_cb,
+        .arg = slot,
+        .name = job->name,
+    };
+    if (esp_timer_create(&args, &slot->timer) != ESP_OK) {
+        fuse();
+        return -1;
+    }
+    if (xTaskCreate(job_task, job->name, job->stack_size, slot, job->priority,
+                    &slot->task) != pdPASS) {
+        fuse();
+        return -1;
+    }
+    status = running;
+    return count++;
+}
+
+/**
+ * @brief release the job now, then every period
+ */
+void NAR_SCHED_resume(int id) {
+    if (status != running || id < 0 || id >= count) {
+        return;
+    }
+    slot_t* slot = &slots[id];
+    portENTER_CRITICAL(&lock);
+    uint8_t was = slot->suspended;
+    slot->suspended = 0;
+    portEXIT_CRITICAL(&lock);
+    if (!was) {
+        return;
+    }
+    if (slot->job.period_ms) {
+        esp_timer_start_periodic(slot->timer, slot->job.period_ms * 1000LL);
+        timer_cb(slot);
+    }
+}
+
+/**
+ * @brief no more releases, a run in progress still finishes
+ */
+void NAR_SCHED_suspend(int id) {
+    if (status != running || id < 0 || id >= count) {
+        return;
+    }
+    slot_t* slot = &slots[id];
+    esp_timer_stop(slot->timer);
+    portENTER_CRITICAL(&lock);
+    slot->suspended = 1;
+    slot->release = 0;
+    portEXIT_CRITICAL(&lock);
+}
+
+/**
+ * @brief release the job once now, ignored while suspended
+ */
+void NAR_SCHED_trigger(int id) {
+    if (status != running || id < 0 || id >= count) {
+        return;
+    }
+    timer_cb(&slots[id]);
+}
+
+/**
+ * @brief NAR_SCHED_trigger() for a gpio isr
+ */
+void NAR_SCHED_trigger_from_isr(int id) {
+    if (status != running || id < 0 || id >= count) {
+        return;
+    }
+    slot_t* slot = &slots[id];
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_ISR(&lock);
+    uint8_t notify = release(slot, now);
+    portEXIT_CRITICAL_ISR(&lock);
+    if (notify) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(slot->task, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+/**
+ * @param[in] period_ms 0 - only when triggered from now on
+ */
+void NAR_SCHED_set_period(int id, uint32_t period_ms) {
+    if (status != running || id < 0 || id >= count) {
+        return;
+    }
+    slot_t* slot = &slots[id];
+    if (slot->job.period_ms == period_ms) {
+        return;
+    }
+    slot->job.period_ms = period_ms;
+    esp_timer_stop(slot->timer);
+    if (period_ms && !slot->suspended) {
+        esp_timer_start_periodic(slot->timer, period_ms * 1000LL);
+    }
+}
+
+/**
+ * @param[out] out since the job was added
+ */
+void NAR_SCHED_get_stats(int id, NAR_SCHED_stats_t* out) {
+    if (id < 0 || id >= count) {
+        return;
+    }
+    portENTER_CRITICAL(&lock);
+    *out = slots[id].stats;
+    portEXIT_CRITICAL(&lock);
+}
+
+/**
+ * @brief one line per job
+ */
+void NAR_SCHED_log() {
+    for (int i = 0; i < count; i++) {
+        NAR_SCHED_stats_t s;
+        NAR_SCHED_get_stats(i, &s);
+        ESP_LOGI(TAG,
+                 "%s: %u runs, run %u us avg %u max, wait %u us max, "
+                 "%u deadline misses, %u overruns",
+                 slots[i].job.name, s.runs,
+                 s.runs ? (uint32_t)(s.total_us / s.runs) : 0, s.max_us,
+                 s.max_wait_us, s.misses, s.overruns);
+    }
+}
\ No newline at end of file
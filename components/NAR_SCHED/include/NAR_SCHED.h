@@ -0,0 +1,51 @@
+/**
+ * @file NAR_SCHED.h
+ * @brief periodic jobs, each on its own task with its own priority
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_SCHED
+#define NARUKARA_SCHED
+
+#include "esp_types.h"
+#include "freertos/FreeRTOS.h"
+
+#define NAR_SCHED_MAX_JOBS (10)
+
+typedef struct {
+    const char* name;
+    void (*run)();
+    uint32_t period_ms;    // 0 - only when triggered
+    uint32_t deadline_ms;  // release to finish, 0 - the period, or none
+    UBaseType_t priority;
+    uint32_t stack_size;
+} NAR_SCHED_job_t;
+
+typedef struct {
+    uint32_t releases;
+    uint32_t runs;
+    uint32_t misses;    // finished after the deadline
+    uint32_t overruns;  // released again before the pending run started
+    uint32_t last_us;   // run time
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t max_wait_us;  // release to start
+} NAR_SCHED_stats_t;
+
+int NAR_SCHED_add(const NAR_SCHED_job_t* job);
+
+void NAR_SCHED_resume(int id);
+
+void NAR_SCHED_suspend(int id);
+
+void NAR_SCHED_trigger(int id);
+
+void NAR_SCHED_trigger_from_isr(int id);
+
+void NAR_SCHED_set_period(int id, uint32_t period_ms);
+
+void NAR_SCHED_get_stats(int id, NAR_SCHED_stats_t* stats);
+
+void NAR_SCHED_log();
+
+#endif
\ No newline at end of file
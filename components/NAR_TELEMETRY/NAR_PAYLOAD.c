@@ -0,0 +1,152 @@
+/**
+ * @file NAR_PAYLOAD.c
+ * @brief binary telemetry batch format, plain C so host tools can share it
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "NAR_PAYLOAD.h"
+
+static uint8_t* put(uint8_t* p, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        *p++ = value >> (8 * i);
+    }
+    return p;
+}
+
+static uint32_t get(const uint8_t* p, uint8_t bytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * @brief byte by byte, so the layout does not depend on the compiler
+ * @param[in] size space in out
+ * @return bytes written
+ * | 0 - out too small
+ */
+size_t NAR_PAYLOAD_encode(const NAR_PAYLOAD_record_t* records,
+                          uint8_t count,
+                          uint8_t* out,
+                          size_t size) {
+    if (size < NAR_PAYLOAD_SIZE(count)) {
+        return 0;
+    }
+    uint8_t* p = out;
+    *p++ = NAR_PAYLOAD_VERSION;
+    *p++ = count;
+    for (uint8_t i = 0; i < count; i++) {
+        p = put(p, records[i].boot, 2);
+        p = put(p, records[i].time, 4);
+        p = put(p, (uint16_t)records[i].temp, 2);
+        p = put(p, records[i].step, 4);
+        *p++ = records[i].hr;
+        *p++ = records[i].flags;
+    }
+    return p - out;
+}
+
+/**
+ * @param[in] max space in records
+ * @return records decoded
+ * | 0 - malformed, unknown version or empty
+ */
+uint8_t NAR_PAYLOAD_decode(const uint8_t* in,
+                           size_t len,
+                           NAR_PAYLOAD_record_t* records,
+                           uint8_t max) {
+    if (len < NAR_PAYLOAD_HEADER_SIZE || in[0] != NAR_PAYLOAD_VERSION) {
+        return 0;
+    }
+    uint8_t count = in[1];
+    if (count > max || len != NAR_PAYLOAD_SIZE(count)) {
+        return 0;
+    }
+    const uint8_t* p = in + NAR_PAYLOAD_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; i++) {
+        records[i].boot = get(p, 2);
+        records[i].time = get(p + 2, 4);
+        records[i].temp = (int16_t)get(p + 6, 2);
+        records[i].step = get(p + 8, 4);
+        records[i].hr = p[12];
+        records[i].flags = p[13];
+        p += NAR_PAYLOAD_RECORD_SIZE;
+    }
+    return count;
+}
+
+/**
+ * @brief one chunk of a raw sample stream
+ * @param[in] values frame->count samples, ir / red or x / y / z
+ * @return bytes written
+ * | 0 - out too small or unknown type
+ */
+size_t NAR_PAYLOAD_encode_frame(const NAR_PAYLOAD_frame_t* frame,
+                                const int32_t (*values)[3],
+                                uint8_t* out,
+                                size_t size) {
+    if (size < NAR_PAYLOAD_FRAME_SIZE(frame->count) ||
+        (frame->type != NAR_PAYLOAD_PPG && frame->type != NAR_PAYLOAD_ACCEL)) {
+        return 0;
+    }
+    uint8_t* p = out;
+    *p++ = NAR_PAYLOAD_VERSION;
+    *p++ = frame->type;
+    *p++ = frame->count;
+    p = put(p, frame->seq, 4);
+    p = put(p, (uint32_t)frame->time, 4);
+    p = put(p, (uint32_t)((uint64_t)frame->time >> 32), 4);
+    p = put(p, frame->period, 2);
+    for (uint8_t i = 0; i < frame->count; i++) {
+        if (frame->type == NAR_PAYLOAD_PPG) {
+            p = put(p, values[i][0], 3);
+            p = put(p, values[i][1], 3);
+        } else {
+            for (uint8_t a = 0; a < 3; a++) {
+                p = put(p, (uint16_t)values[i][a], 2);
+            }
+        }
+    }
+    return p - out;
+}
+
+/**
+ * @param[out] values room for max samples
+ * @return samples decoded
+ * | 0 - malformed, unknown version / type or empty
+ */
+uint8_t NAR_PAYLOAD_decode_frame(const uint8_t* in,
+                                 size_t len,
+                                 NAR_PAYLOAD_frame_t* frame,
+                                 int32_t (*values)[3],
+                                 uint8_t max) {
+    if (len < NAR_PAYLOAD_FRAME_HEADER_SIZE || in[0] != NAR_PAYLOAD_VERSION ||
+        (in[1] != NAR_PAYLOAD_PPG && in[1] != NAR_PAYLOAD_ACCEL)) {
+        return 0;
+    }
+    uint8_t count = in[2];
+    if (count > max || len != NAR_PAYLOAD_FRAME_SIZE(count)) {
+        return 0;
+    }
+    frame->type = in[1];
+    frame->count = count;
+    frame->seq = get(in + 3, 4);
+    frame->time = (int64_t)((uint64_t)get(in + 11, 4) << 32 | get(in + 7, 4));
+    frame->period = get(in + 15, 2);
+    const uint8_t* p = in + NAR_PAYLOAD_FRAME_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; i++) {
+        if (frame->type == NAR_PAYLOAD_PPG) {
+            values[i][0] = get(p, 3);
+            values[i][1] = get(p + 3, 3);
+            values[i][2] = 0;
+        } else {
+            for (uint8_t a = 0; a < 3; a++) {
+                values[i][a] = (int16_t)get(p + 2 * a, 2);
+            }
+        }
+        p += NAR_PAYLOAD_SAMPLE_SIZE;
+    }
+    return count;
+}
\ No newline at end of file
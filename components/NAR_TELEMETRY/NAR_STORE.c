@@ -0,0 +1,258 @@
+/**
+ * @file NAR_STORE.c
+ * @brief ring log of telemetry records in the telemetry flash partition
+ * @author Narukara
+ * @date 2021.2
+ *
+ * The partition is a ring of 18 byte slots, seq(4) + record(14). Record n
+ * always lives in slot n % slots, so appends only ever move forward and
+ * every sector is erased once per lap, right before it is written again.
+ * The seq of the next record to upload is kept in NVS, with the payload
+ * version the ring was written in and a boot counter for record times.
+ */
+#include "NAR_STORE.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+
+static const char* TAG = "NAR_STORE";
+
+static enum { ready, running, error } status = ready;
+
+#define fuse()                                 \
+    ({                                         \
+        status = error;                        \
+        ESP_LOGE(TAG, "fuse at %d", __LINE__); \
+    })
+
+#define PARTITION_SUBTYPE (0x40)
+#define SLOT_SIZE (4 + NAR_PAYLOAD_RECORD_SIZE)
+#define SECTOR_SLOTS (SPI_FLASH_SEC_SIZE / SLOT_SIZE)
+#define EMPTY (0xffffffff)
+
+static const esp_partition_t* partition = NULL;
+static SemaphoreHandle_t lock = NULL;
+static nvs_handle_t nvs = 0;
+static uint32_t slots = 0;
+static uint32_t head = 0;  // seq of the next append
+static uint32_t sent = 0;  // seq of the next record to upload
+static uint32_t lost = 0;
+static uint16_t boot = 0;
+
+static inline uint32_t slot_address(uint32_t seq) {
+    return (seq % slots) * SLOT_SIZE;
+}
+
+static uint32_t read_seq(uint32_t slot) {
+    uint32_t seq = EMPTY;
+    if (esp_partition_read(partition, slot * SLOT_SIZE, &seq, 4) != ESP_OK) {
+        return EMPTY;
+    }
+    return seq;
+}
+
+/**
+ * @return seq of the oldest record the ring still holds
+ */
+static uint32_t oldest() {
+    // every sector but the one being written holds a full lap back
+    uint32_t base = head - head % SECTOR_SLOTS;
+    uint32_t span = slots - SECTOR_SLOTS;
+    return base > span ? base - span : 0;
+}
+
+/**
+ * @brief find head from the seq stored in the first slot of each sector
+ */
+static void recover() {
+    uint32_t best = EMPTY;
+    for (uint32_t s = 0; s < slots; s += SECTOR_SLOTS) {
+        uint32_t seq = read_seq(s);
+        if (seq != EMPTY && (best == EMPTY || seq > best)) {
+            best = seq;
+        }
+    }
+    if (best == EMPTY) {
+        head = 0;
+        return;
+    }
+    head = best;
+    while (head + 1 - best < SECTOR_SLOTS &&
+           read_seq((head + 1) % slots) == head + 1) {
+        head++;
+    }
+    head++;
+}
+
+void NAR_STORE_init() {
+    if (status != ready) {
+        return;
+    }
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         PARTITION_SUBTYPE, "telemetry");
+    if (partition == NULL) {
+        fuse();
+        return;
+    }
+    slots = partition->size / SPI_FLASH_SEC_SIZE * SECTOR_SLOTS;
+    lock = xSemaphoreCreateMutex();
+    if (lock == NULL) {
+        fuse();
+        return;
+    }
+    if (nvs_open("telemetry", NVS_READWRITE, &nvs) != ESP_OK) {
+        fuse();
+        return;
+    }
+    uint8_t version = 0;
+    nvs_get_u8(nvs, "version", &version);
+    if (version != NAR_PAYLOAD_VERSION) {
+        // slots in another layout would decode as garbage, an empty ring
+        // also brings sent back to 0 below
+        if (esp_partition_erase_range(partition, 0, partition->size) !=
+                ESP_OK ||
+            nvs_set_u8(nvs, "version", NAR_PAYLOAD_VERSION) != ESP_OK) {
+            fuse();
+            return;
+        }
+        ESP_LOGW(TAG, "ring from payload version %u dropped", version);
+    }
+    nvs_get_u16(nvs, "boot", &boot);
+    boot++;
+    if (nvs_set_u16(nvs, "boot", boot) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        fuse();
+        return;
+    }
+    recover();
+    if (nvs_get_u32(nvs, "sent", &sent) != ESP_OK || sent > head) {
+        sent = head;
+    }
+    if (sent < oldest()) {
+        sent = oldest();
+    }
+    status = running;
+    ESP_LOGI(TAG, "boot %u, %u slots, %u records to upload", boot, slots,
+             head - sent);
+}
+
+/**
+ * @brief write one record, erasing the next sector when a lap comes round.
+ * Records not uploaded yet in that sector are lost.
+ */
+void NAR_STORE_append(const NAR_PAYLOAD_record_t* record) {
+    if (status != running) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t address = slot_address(head);
+    if (head % SECTOR_SLOTS == 0 &&
+        esp_partition_erase_range(partition, address, SPI_FLASH_SEC_SIZE) !=
+            ESP_OK) {
+        fuse();
+        xSemaphoreGive(lock);
+        return;
+    }
+    uint8_t buf[NAR_PAYLOAD_SIZE(1)];
+    NAR_PAYLOAD_encode(record, 1, buf, sizeof(buf));
+    // record first, seq last, so a torn write leaves the slot empty
+    if (esp_partition_write(partition, address + 4,
+                            buf + NAR_PAYLOAD_HEADER_SIZE,
+                            NAR_PAYLOAD_RECORD_SIZE) != ESP_OK ||
+        esp_partition_write(partition, address, &head, 4) != ESP_OK) {
+        fuse();
+        xSemaphoreGive(lock);
+        return;
+    }
+    head++;
+    if (sent < oldest()) {
+        lost += oldest() - sent;
+        sent = oldest();
+    }
+    xSemaphoreGive(lock);
+}
+
+/**
+ * @brief peek at the oldest records not uploaded yet, from the resume offset
+ * @param[in] max space in records
+ * @param[out] next pass to NAR_STORE_commit() once the records are delivered
+ * @return records read
+ */
+uint8_t NAR_STORE_read(NAR_PAYLOAD_record_t* records,
+                       uint8_t max,
+                       uint32_t* next) {
+    if (status != running) {
+        return 0;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint8_t count = 0;
+    uint8_t buf[NAR_PAYLOAD_SIZE(1)] = {NAR_PAYLOAD_VERSION, 1};
+    for (uint32_t seq = sent; seq < head && count < max; seq++) {
+        uint32_t stored = EMPTY;
+        if (esp_partition_read(partition, slot_address(seq), &stored, 4) !=
+                ESP_OK ||
+            esp_partition_read(partition, slot_address(seq) + 4,
+                               buf + NAR_PAYLOAD_HEADER_SIZE,
+                               NAR_PAYLOAD_RECORD_SIZE) != ESP_OK) {
+            break;
+        }
+        if (stored != seq) {
+            // torn by a reset, skip it or it blocks the upload for good
+            if (count == 0) {
+                sent = seq + 1;
+                lost++;
+                continue;
+            }
+            break;
+        }
+        NAR_PAYLOAD_decode(buf, sizeof(buf), &records[count++], 1);
+    }
+    *next = sent + count;
+    xSemaphoreGive(lock);
+    return count;
+}
+
+/**
+ * @brief records from NAR_STORE_read() are delivered, move the resume
+ * offset past them and save it
+ * @param[in] next from NAR_STORE_read()
+ */
+void NAR_STORE_commit(uint32_t next) {
+    if (status != running) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (next > sent && next <= head) {
+        sent = next;
+    }
+    if (sent < oldest()) {
+        sent = oldest();
+    }
+    if (nvs_set_u32(nvs, "sent", sent) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "resume offset not saved");
+    }
+    xSemaphoreGive(lock);
+}
+
+/**
+ * @return records waiting for upload
+ */
+uint32_t NAR_STORE_get_pending() {
+    return head - sent;
+}
+
+/**
+ * @return records overwritten before they were uploaded
+ */
+uint32_t NAR_STORE_get_lost() {
+    return lost;
+}
+
+/**
+ * @return times since boot in records from different boots compare by this
+ * first, it counts every NAR_STORE_init() and wraps after 65535
+ */
+uint16_t NAR_STORE_get_boot() {
+    return boot;
+}
\ No newline at end of file
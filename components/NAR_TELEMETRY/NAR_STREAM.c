@@ -0,0 +1,149 @@
+/**
+ * @file NAR_STREAM.c
+ * @brief raw PPG / accelerometer samples from NAR_BUS to MQTT, in frames
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "NAR_STREAM.h"
+#include "NAR_BUS.h"
+#include "NAR_MQTT.h"
+#include "NAR_PAYLOAD.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "NAR_STREAM";
+
+// 20 samples per channel and frame at 100 Hz, well inside the NAR_BUS ring
+#define STREAM_PERIOD_MS (200)
+#define STREAM_STACK_SIZE (4096)
+// a stopping stream task is done within a period, wait that long and more
+#define STOP_WAIT_MS (1000)
+// esp-mqtt default buffer, minus fixed header, topic and some slack
+#define MQTT_BUFFER_SIZE (1024)
+#define MQTT_HEADROOM (64)
+#define FRAME_SAMPLES                                         \
+    ((MQTT_BUFFER_SIZE - MQTT_HEADROOM -                      \
+      NAR_PAYLOAD_FRAME_HEADER_SIZE) / NAR_PAYLOAD_SAMPLE_SIZE)
+
+static const uint8_t types[NAR_BUS_CHANNELS] = {
+    [NAR_BUS_PPG] = NAR_PAYLOAD_PPG,
+    [NAR_BUS_ACCEL] = NAR_PAYLOAD_ACCEL,
+};
+
+static const char* topic = NULL;
+static TaskHandle_t task = NULL;
+static volatile uint8_t streaming = 0;
+
+static struct {
+    uint32_t cursor;
+    uint32_t frames;
+    uint32_t samples;
+    uint32_t lost;  // overrun in NAR_BUS or not published
+} channels[NAR_BUS_CHANNELS];
+
+/**
+ * @brief publish everything new on one channel, as frames of at most
+ * FRAME_SAMPLES
+ */
+static void stream_channel(uint8_t c) {
+    static NAR_BUS_sample_t samples[FRAME_SAMPLES];
+    static int32_t values[FRAME_SAMPLES][3];
+    static uint8_t payload[NAR_PAYLOAD_FRAME_SIZE(FRAME_SAMPLES)];
+    uint32_t before = channels[c].cursor;
+    uint32_t n;
+    while ((n = NAR_BUS_read(c, &channels[c].cursor, samples,
+                             FRAME_SAMPLES))) {
+        // the bus skips ahead if we fell behind, seq shows the gap
+        uint32_t seq = channels[c].cursor - n;
+        channels[c].lost += seq - before;
+        before = channels[c].cursor;
+        for (uint32_t i = 0; i < n; i++) {
+            for (uint8_t a = 0; a < 3; a++) {
+                values[i][a] = samples[i].value[a];
+            }
+        }
+        NAR_PAYLOAD_frame_t frame = {
+            .type = types[c],
+            .count = n,
+            .seq = seq,
+            .time = samples[0].time,
+            .period =
+                n > 1 ? (samples[n - 1].time - samples[0].time) / (n - 1) : 0,
+        };
+        size_t len =
+            NAR_PAYLOAD_encode_frame(&frame, values, payload, sizeof(payload));
+        if (NAR_MQTT_pub_bin(NAR_MQTT_LIVE, topic, payload, len) < 0) {
+            channels[c].lost += n;
+            continue;
+        }
+        channels[c].frames++;
+        channels[c].samples += n;
+    }
+}
+
+static void stream_task(void* pvParameters) {
+    for (uint8_t c = 0; c < NAR_BUS_CHANNELS; c++) {
+        NAR_BUS_request(c, 1);
+        // only what is sampled from now on
+        NAR_BUS_sample_t foo;
+        while (NAR_BUS_read(c, &channels[c].cursor, &foo, 1)) {
+        }
+        channels[c].frames = channels[c].samples = channels[c].lost = 0;
+    }
+    TickType_t last = xTaskGetTickCount();
+    while (streaming) {
+        vTaskDelayUntil(&last, STREAM_PERIOD_MS / portTICK_PERIOD_MS);
+        for (uint8_t c = 0; c < NAR_BUS_CHANNELS; c++) {
+            stream_channel(c);
+        }
+    }
+    for (uint8_t c = 0; c < NAR_BUS_CHANNELS; c++) {
+        NAR_BUS_request(c, 0);
+        ESP_LOGI(TAG, "channel %u: %u frames, %u samples, %u lost", c,
+                 channels[c].frames, channels[c].samples, channels[c].lost);
+    }
+    task = NULL;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief publish every NAR_BUS channel on topic with the LIVE policy until
+ * NAR_STREAM_stop(). The producers have to be started separately. Right
+ * after a stop, waits up to STOP_WAIT_MS for the last stream to end.
+ * @param[in] stream_topic must outlive the stream
+ */
+void NAR_STREAM_start(const char* stream_topic) {
+    if (streaming || stream_topic == NULL) {
+        return;
+    }
+    for (uint8_t i = 0; task && i < STOP_WAIT_MS / STREAM_PERIOD_MS; i++) {
+        vTaskDelay(STREAM_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+    if (task) {
+        ESP_LOGW(TAG, "last stream still stopping");
+        return;
+    }
+    topic = stream_topic;
+    streaming = 1;
+    xTaskCreate(stream_task, "stream", STREAM_STACK_SIZE, NULL,
+                tskIDLE_PRIORITY + 1, &task);
+    if (task == NULL) {
+        streaming = 0;
+        ESP_LOGE(TAG, "no stream task");
+    }
+}
+
+/**
+ * @brief stops within STREAM_PERIOD_MS
+ */
+void NAR_STREAM_stop() {
+    streaming = 0;
+}
+
+/**
+ * @return 1 while streaming
+ */
+uint8_t NAR_STREAM_get_streaming() {
+    return task != NULL;
+}
\ No newline at end of file
@@ -0,0 +1,379 @@
+/**
+ * @file NAR_TELEMETRY.c
+ * @brief batches sensor records and publishes them as one binary message
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "NAR_TELEMETRY.h"
+#include "NAR_MQTT.h"
+#include "NAR_STORE.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "stdio.h"
+#include "string.h"
+
+static const char* TAG = "NAR_TELEMETRY";
+
+static enum { ready, running, error } status = ready;
+
+#define fuse()                                 \
+    ({                                         \
+        status = error;                        \
+        ESP_LOGE(TAG, "fuse at %d", __LINE__); \
+    })
+
+// 5 min of records at the 10 s sensor period
+#define BATCH_RECORDS (30)
+#define HOUR_US (3600000000LL)
+// the backlog goes out one batch at a time, the next after the PUBACK
+#define UPLOAD_POLL_MS (1000)
+#define ACK_TIMEOUT_US (10000000LL)
+#define ACKED_LENGTH (8)
+// a duty cycle window ends when the backlog is out, or after this long
+#define SYNC_TIMEOUT_US (60000000LL)
+
+// wire model of one QoS1 publish over mqtts, per message. Fixed overheads
+// and airtime, nothing here is measured on the air
+#define TLS_OVERHEAD (29)  // record header, explicit nonce, GCM tag
+#define IP_OVERHEAD (40)   // IPv4 + TCP
+#define MAC_OVERHEAD (36)  // 802.11 header, LLC/SNAP, FCS
+#define PUBACK_SIZE (4)
+#define FRAME_US (100)    // DIFS, backoff, preamble, SIFS, MAC ack
+#define BYTE_NS (333)     // 24 Mbit/s
+#define RTT_US (30000)    // radio stays up until the PUBACK arrives
+// topics the text scheme used, "%.2lf" temp, "%lu" step, "%u" hr
+#define LEGACY_TOPIC_LEN (10)
+#define LEGACY_HR_TOPIC_LEN (8)
+
+static const char* topic = NULL;
+static const char* last_topic = NULL;
+static NAR_PAYLOAD_record_t records[BATCH_RECORDS];
+static uint8_t count = 0;
+static SemaphoreHandle_t records_lock = NULL;
+
+static SemaphoreHandle_t kick = NULL;
+static volatile int acked[ACKED_LENGTH];
+static volatile uint8_t acked_head = 0;
+static int inflight = -1;
+
+static int64_t duty_period_us = 0;  // 0 - the caller owns the radio
+static int64_t next_sync = 0;
+static int64_t sync_start = 0;
+static uint8_t syncing = 0;
+static volatile uint8_t sync_requested = 0;
+
+// modelled by account(), not measured
+typedef struct {
+    uint32_t messages;
+    uint32_t bytes;    // estimate, the wire model's overheads included
+    int64_t radio_us;  // estimate, airtime and one RTT per message
+} traffic_t;
+
+static traffic_t batched, legacy;
+static int64_t hour_start = 0;
+static int64_t hour_radio_on = 0;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief estimate one QoS1 exchange, PUBLISH out and PUBACK back, with the
+ * wire model above. Only the payload and topic sizes are real
+ */
+static void account(traffic_t* stats, size_t topic_len, size_t len) {
+    size_t remaining = 2 + topic_len + 2 + len;
+    size_t publish = 1 + (remaining > 127 ? 2 : 1) + remaining;
+    size_t bytes = publish + PUBACK_SIZE +
+                   2 * (TLS_OVERHEAD + IP_OVERHEAD + MAC_OVERHEAD);
+    portENTER_CRITICAL(&stats_lock);
+    stats->messages++;
+    stats->bytes += bytes;
+    stats->radio_us += 2 * FRAME_US + bytes * BYTE_NS / 1000 + RTT_US;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/**
+ * @brief modelled cost of publishing this record one value per message, for
+ * comparison, nothing is sent
+ */
+static void account_legacy(double temp, unsigned long step, uint8_t hr) {
+    char msg[16];
+    account(&legacy, LEGACY_TOPIC_LEN, snprintf(msg, 16, "%.2lf", temp));
+    account(&legacy, LEGACY_TOPIC_LEN, snprintf(msg, 16, "%lu", step));
+    if (hr) {
+        account(&legacy, LEGACY_HR_TOPIC_LEN, snprintf(msg, 16, "%u", hr));
+    }
+}
+
+static void hourly_log() {
+    int64_t now = esp_timer_get_time();
+    if (now - hour_start < HOUR_US) {
+        return;
+    }
+    portENTER_CRITICAL(&stats_lock);
+    traffic_t b = batched, l = legacy;
+    memset(&batched, 0, sizeof(batched));
+    memset(&legacy, 0, sizeof(legacy));
+    portEXIT_CRITICAL(&stats_lock);
+    int64_t radio_on = NAR_MQTT_get_radio_on_time();
+    ESP_LOGI(TAG, "last hour, modelled: %u msg ~%u B ~%u ms air, one value "
+             "per msg would be %u msg ~%u B ~%u ms air",
+             b.messages, b.bytes, (uint32_t)(b.radio_us / 1000), l.messages,
+             l.bytes, (uint32_t)(l.radio_us / 1000));
+    ESP_LOGI(TAG, "last hour, measured: radio on %u s, backlog %u, lost %u",
+             (uint32_t)((radio_on - hour_radio_on) / 1000000),
+             NAR_STORE_get_pending(), NAR_STORE_get_lost());
+    NAR_MQTT_pub_stats_t pub;
+    NAR_MQTT_get_pub_stats(&pub);
+    ESP_LOGI(TAG, "since boot: %u pub %u B, PUBACK p50 %u p90 %u p99 %u max "
+             "%u ms, ~%u retransmits, %u dropped, outbox %u msg %d B",
+             pub.published, pub.bytes, pub.p50_ms, pub.p90_ms, pub.p99_ms,
+             pub.max_ms, pub.retransmits, pub.dropped, pub.inflight,
+             pub.outbox_bytes);
+    hour_start = now;
+    hour_radio_on = radio_on;
+}
+
+static void published_cb(int msg_id) {
+    acked[acked_head++ % ACKED_LENGTH] = msg_id;
+    xSemaphoreGive(kick);
+}
+
+static uint8_t is_acked(int msg_id) {
+    for (uint8_t i = 0; i < ACKED_LENGTH; i++) {
+        if (acked[i] == msg_id) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief records that can not go out now go to flash, records_lock held
+ */
+static void spill() {
+    for (uint8_t i = 0; i < count; i++) {
+        NAR_STORE_append(&records[i]);
+    }
+    count = 0;
+}
+
+/**
+ * @brief duty cycle mode, switch the radio on every period or on request,
+ * off again once the backlog is acked
+ */
+static void duty_step() {
+    int64_t now = esp_timer_get_time();
+    if (!syncing) {
+        if (!sync_requested && now < next_sync) {
+            return;
+        }
+        sync_requested = 0;
+        syncing = 1;
+        sync_start = now;
+        next_sync = now + duty_period_us;
+        // everything goes through the acked upload path
+        xSemaphoreTake(records_lock, portMAX_DELAY);
+        spill();
+        xSemaphoreGive(records_lock);
+        NAR_MQTT_start();
+        return;
+    }
+    // whatever was flushed meanwhile is in flash and goes out in this window
+    sync_requested = 0;
+    uint8_t done = NAR_MQTT_get_connected() && inflight < 0 &&
+                   NAR_STORE_get_pending() == 0;
+    if (done || now - sync_start > SYNC_TIMEOUT_US) {
+        NAR_MQTT_end();
+        syncing = 0;
+        ESP_LOGI(TAG, "sync %s in %u ms", done ? "done" : "timed out",
+                 (uint32_t)((now - sync_start) / 1000));
+    }
+}
+
+/**
+ * @brief uploads the flash backlog, one batch in flight at a time. The
+ * resume offset only moves once the broker acked, a batch without ack is
+ * sent again.
+ */
+static void upload_task(void* arg) {
+    static NAR_PAYLOAD_record_t backlog[BATCH_RECORDS];
+    static uint8_t payload[NAR_PAYLOAD_SIZE(BATCH_RECORDS)];
+    uint32_t next = 0;
+    int64_t sent_at = 0;
+    while (1) {
+        xSemaphoreTake(kick, UPLOAD_POLL_MS / portTICK_PERIOD_MS);
+        if (duty_period_us) {
+            duty_step();
+        } else {
+            // turned off mid window, the link is the caller's from now on
+            syncing = 0;
+        }
+        if (inflight >= 0) {
+            if (is_acked(inflight)) {
+                NAR_STORE_commit(next);
+            } else if (NAR_MQTT_get_connected() &&
+                       esp_timer_get_time() - sent_at < ACK_TIMEOUT_US) {
+                continue;
+            }
+            inflight = -1;
+        }
+        if (!NAR_MQTT_get_connected()) {
+            continue;
+        }
+        uint8_t n = NAR_STORE_read(backlog, BATCH_RECORDS, &next);
+        if (n == 0) {
+            continue;
+        }
+        size_t len = NAR_PAYLOAD_encode(backlog, n, payload, sizeof(payload));
+        inflight = NAR_MQTT_pub_bin(NAR_MQTT_BATCH, topic, payload, len);
+        sent_at = esp_timer_get_time();
+        if (inflight >= 0) {
+            account(&batched, strlen(topic), len);
+        }
+    }
+}
+
+/**
+ * @param[in] batch_topic must outlive the module
+ * @param[in] retained_topic the newest record, retained, Nullable
+ */
+void NAR_TELEMETRY_init(const char* batch_topic, const char* retained_topic) {
+    if (status != ready) {
+        return;
+    }
+    if (batch_topic == NULL) {
+        fuse();
+        return;
+    }
+    topic = batch_topic;
+    last_topic = retained_topic;
+    hour_start = esp_timer_get_time();
+    for (uint8_t i = 0; i < ACKED_LENGTH; i++) {
+        acked[i] = -1;
+    }
+    // needs nvs_flash_init(), NAR_MQTT_init() does that
+    NAR_STORE_init();
+    kick = xSemaphoreCreateBinary();
+    records_lock = xSemaphoreCreateMutex();
+    if (kick == NULL || records_lock == NULL) {
+        fuse();
+        return;
+    }
+    NAR_MQTT_set_published_callback(published_cb);
+    TaskHandle_t handle = NULL;
+    xTaskCreate(upload_task, "telemetry", 3072, NULL, tskIDLE_PRIORITY + 1,
+                &handle);
+    if (handle == NULL) {
+        fuse();
+        return;
+    }
+    status = running;
+}
+
+/**
+ * @brief queue a record, the batch goes out once it is full
+ * @param[in] temp degree
+ * @param[in] hr 0 if not measured since the last record
+ * @param[in] flags NAR_PAYLOAD_FEVER | NAR_PAYLOAD_LONG_SIT
+ */
+void NAR_TELEMETRY_add(double temp,
+                       unsigned long step,
+                       uint8_t hr,
+                       uint8_t flags) {
+    if (status != running) {
+        return;
+    }
+    xSemaphoreTake(records_lock, portMAX_DELAY);
+    if (count == BATCH_RECORDS) {
+        // filled by another task that has not flushed yet, keep it in flash
+        spill();
+    }
+    NAR_PAYLOAD_record_t* r = &records[count++];
+    r->boot = NAR_STORE_get_boot();
+    r->time = esp_timer_get_time() / 1000000;
+    r->temp = temp * 100 + (temp < 0 ? -0.5 : 0.5);
+    r->step = step;
+    r->hr = hr;
+    r->flags = flags;
+    uint8_t full = count == BATCH_RECORDS;
+    xSemaphoreGive(records_lock);
+    account_legacy(temp, step, hr);
+    if (full) {
+        NAR_TELEMETRY_flush();
+    }
+    hourly_log();
+}
+
+/**
+ * @brief publish everything queued now, e.g. on an alert or a fresh hr.
+ * Offline or in duty cycle mode, the records go to the flash log and are
+ * uploaded on reconnect / in the next radio window.
+ */
+void NAR_TELEMETRY_flush() {
+    if (status != running) {
+        return;
+    }
+    if (NAR_MQTT_get_connected()) {
+        // and whatever still waits in flash
+        xSemaphoreGive(kick);
+    }
+    xSemaphoreTake(records_lock, portMAX_DELAY);
+    if (count == 0) {
+        xSemaphoreGive(records_lock);
+        return;
+    }
+    if (duty_period_us == 0) {
+        static uint8_t payload[NAR_PAYLOAD_SIZE(BATCH_RECORDS)];
+        size_t len =
+            NAR_PAYLOAD_encode(records, count, payload, sizeof(payload));
+        if (NAR_MQTT_pub_bin(NAR_MQTT_BATCH, topic, payload, len) >= 0) {
+            account(&batched, strlen(topic), len);
+            if (last_topic) {
+                // a dashboard opened later still finds the current values
+                len = NAR_PAYLOAD_encode(&records[count - 1], 1, payload,
+                                         sizeof(payload));
+                NAR_MQTT_pub_bin(NAR_MQTT_LAST, last_topic, payload, len);
+            }
+            count = 0;
+        }
+    }
+    spill();
+    xSemaphoreGive(records_lock);
+}
+
+/**
+ * @brief duty cycle mode, the radio only comes up to upload the backlog,
+ * then goes off again. Do not call NAR_MQTT_start() / NAR_MQTT_end()
+ * meanwhile.
+ * @param[in] minutes between radio windows
+ * | 0 - off, the caller keeps the link up as it likes
+ */
+void NAR_TELEMETRY_set_duty_cycle(uint32_t minutes) {
+    int64_t period = minutes * 60000000LL;
+    if (period == duty_period_us) {
+        // unchanged, keep the window that is due
+        return;
+    }
+    next_sync = esp_timer_get_time() + period;
+    duty_period_us = period;
+}
+
+/**
+ * @brief open a radio window now, e.g. on an alert. Only in duty cycle mode.
+ */
+void NAR_TELEMETRY_sync() {
+    if (status != running || duty_period_us == 0) {
+        return;
+    }
+    sync_requested = 1;
+    xSemaphoreGive(kick);
+}
+
+/**
+ * @return records lost because the flash log wrapped while offline
+ */
+uint32_t NAR_TELEMETRY_get_dropped() {
+    return NAR_STORE_get_lost();
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+/**
+ * @file NAR_PAYLOAD.h
+ * @brief binary telemetry batch format, plain C so host tools can share it
+ * @author Narukara
+ * @date 2021.2
+ *
+ * batch = version(1) count(1) record * count, all little endian
+ * record = boot(2) time(4) temp(2) step(4) hr(1) flags(1)
+ *
+ * frame = version(1) type(1) count(1) seq(4) time(8) period(2) sample * count
+ * ppg sample = ir(3) red(3), accel sample = x(2) y(2) z(2)
+ */
+#ifndef NARUKARA_PAYLOAD
+#define NARUKARA_PAYLOAD
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NAR_PAYLOAD_VERSION (2)
+#define NAR_PAYLOAD_HEADER_SIZE (2)
+#define NAR_PAYLOAD_RECORD_SIZE (14)
+#define NAR_PAYLOAD_SIZE(count) \
+    (NAR_PAYLOAD_HEADER_SIZE + (count)*NAR_PAYLOAD_RECORD_SIZE)
+
+#define NAR_PAYLOAD_FEVER (1 << 0)
+#define NAR_PAYLOAD_LONG_SIT (1 << 1)
+
+#define NAR_PAYLOAD_FRAME_HEADER_SIZE (17)
+#define NAR_PAYLOAD_SAMPLE_SIZE (6)
+#define NAR_PAYLOAD_FRAME_SIZE(count) \
+    (NAR_PAYLOAD_FRAME_HEADER_SIZE + (count)*NAR_PAYLOAD_SAMPLE_SIZE)
+
+#define NAR_PAYLOAD_PPG (1)
+#define NAR_PAYLOAD_ACCEL (2)
+
+typedef struct {
+    uint16_t boot;  // boot counter from NVS, orders records across reboots
+    uint32_t time;  // s since that boot
+    int16_t temp;   // 0.01 degree
+    uint32_t step;
+    uint8_t hr;  // 0 - not measured since the last record
+    uint8_t flags;
+} NAR_PAYLOAD_record_t;
+
+typedef struct {
+    uint8_t type;  // NAR_PAYLOAD_PPG / NAR_PAYLOAD_ACCEL
+    uint8_t count;
+    uint32_t seq;     // index of the first sample in its stream
+    int64_t time;     // first sample, us since boot
+    uint16_t period;  // mean sample spacing, us
+} NAR_PAYLOAD_frame_t;
+
+size_t NAR_PAYLOAD_encode(const NAR_PAYLOAD_record_t* records,
+                          uint8_t count,
+                          uint8_t* out,
+                          size_t size);
+
+uint8_t NAR_PAYLOAD_decode(const uint8_t* in,
+                           size_t len,
+                           NAR_PAYLOAD_record_t* records,
+                           uint8_t max);
+
+size_t NAR_PAYLOAD_encode_frame(const NAR_PAYLOAD_frame_t* frame,
+                                const int32_t (*values)[3],
+                                uint8_t* out,
+                                size_t size);
+
+uint8_t NAR_PAYLOAD_decode_frame(const uint8_t* in,
+                                 size_t len,
+                                 NAR_PAYLOAD_frame_t* frame,
+                                 int32_t (*values)[3],
+                                 uint8_t max);
+
+#endif
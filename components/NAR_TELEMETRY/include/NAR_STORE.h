@@ -0,0 +1,29 @@
+/**
+ * @file NAR_STORE.h
+ * @brief ring log of telemetry records in the telemetry flash partition
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_STORE
+#define NARUKARA_STORE
+
+#include "NAR_PAYLOAD.h"
+#include "esp_types.h"
+
+void NAR_STORE_init();
+
+void NAR_STORE_append(const NAR_PAYLOAD_record_t* record);
+
+uint8_t NAR_STORE_read(NAR_PAYLOAD_record_t* records,
+                       uint8_t max,
+                       uint32_t* next);
+
+void NAR_STORE_commit(uint32_t next);
+
+uint32_t NAR_STORE_get_pending();
+
+uint32_t NAR_STORE_get_lost();
+
+uint16_t NAR_STORE_get_boot();
+
+#endif
@@ -0,0 +1,18 @@
+/**
+ * @file NAR_STREAM.h
+ * @brief raw PPG / accelerometer samples from NAR_BUS to MQTT, in frames
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_STREAM
+#define NARUKARA_STREAM
+
+#include "esp_types.h"
+
+void NAR_STREAM_start(const char* topic);
+
+void NAR_STREAM_stop();
+
+uint8_t NAR_STREAM_get_streaming();
+
+#endif
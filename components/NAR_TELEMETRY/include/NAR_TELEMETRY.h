@@ -0,0 +1,28 @@
+/**
+ * @file NAR_TELEMETRY.h
+ * @brief batches sensor records and publishes them as one binary message
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_TELEMETRY
+#define NARUKARA_TELEMETRY
+
+#include "NAR_PAYLOAD.h"
+#include "esp_types.h"
+
+void NAR_TELEMETRY_init(const char* batch_topic, const char* retained_topic);
+
+void NAR_TELEMETRY_add(double temp,
+                       unsigned long step,
+                       uint8_t hr,
+                       uint8_t flags);
+
+void NAR_TELEMETRY_flush();
+
+void NAR_TELEMETRY_set_duty_cycle(uint32_t minutes);
+
+void NAR_TELEMETRY_sync();
+
+uint32_t NAR_TELEMETRY_get_dropped();
+
+#endif
@@ -5,11 +5,19 @@
  * @author Narukara
  * @date 2021.2
  */
+#include "NAR_BUS.h"
 #include "NAR_I2C.h"
+#include "SSD1306.h"
+#include "esp_crc.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "font.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "math.h"
+#include "stdio.h"
 #include "string.h"
 
 #define SSD1306 (0x3c)
@@ -56,6 +64,100 @@ static const char* TAG = "SSD1306";
  */
 static uint8_t buffer[1024];
 
+/**
+ * buffer is the back buffer, only the displaying task renders into it. Per
+ * page, dirty_begin..dirty_end is the column range changed since the last
+ * submit. A clean page has dirty_begin > dirty_end.
+ *
+ * front is the latest submitted frame, front_begin..front_end what changed
+ * in it since SSD1306_task took it. A frame submitted before the previous
+ * one was taken replaces it (counted in dropped).
+ *
+ * gddram is the GDDRAM content once the running push ends, SSD1306_task
+ * sends from it, so producers never wait for I2C.
+ */
+static uint8_t dirty_begin[8];
+static uint8_t dirty_end[8];
+#define CLEAN_BEGIN (128)
+
+static uint8_t front[1024];
+static uint8_t front_begin[8];
+static uint8_t front_end[8];
+static uint8_t pending = 0;
+static uint32_t dropped = 0;
+static SemaphoreHandle_t lock = NULL;  // front, front_*, pending, gddram
+static SemaphoreHandle_t frame_ready = NULL;
+
+static uint8_t gddram[1024];
+static uint8_t gddram_valid = 0;
+static uint16_t frame_bytes = 0;
+static uint16_t frame_transactions = 0;
+static uint8_t dump = 0;
+
+// pushes are at least MIN_FRAME_MS apart, submits in between are merged
+#define MIN_FRAME_MS (100)
+#define HOUR_US (3600000000LL)
+static TickType_t last_push = 0;
+static uint32_t frames = 0;           // pushed in the current hour
+static uint32_t frames_per_hour = 0;  // pushed in the last full hour
+static int64_t hour_begin = 0;
+
+#define CHUNK_SIZE (16)
+#define STACK_SIZE (2048)
+#define BENCHMARK_ROUNDS (4)
+#define I2C_DEFAULT_FREQ (100000)
+static SSD1306_mode_t mode = SSD1306_MODE_PAGE;
+static uint8_t benchmark = 0;  // run by SSD1306_init
+static void SSD1306_run_benchmark();
+
+/**
+ * While wave is set, SSD1306_task plots the PPG signal in pages
+ * WAVE_FIRST_PAGE..7 every WAVE_PERIOD_MS. Each step scrolls the area one
+ * column left in GDDRAM (content scroll, 0x2D) and writes the new column,
+ * about 30 bytes on the bus instead of a frame. gddram is scrolled too, so
+ * later pushes still diff against the real panel content.
+ */
+#define WAVE_FIRST_PAGE (2)
+#define WAVE_PAGES (8 - WAVE_FIRST_PAGE)
+#define WAVE_HEIGHT (WAVE_PAGES * 8)
+#define WAVE_PERIOD_MS (40)
+#define WAVE_READ (8)
+#define WAVE_DC_ALPHA (1.0f / 64)  // baseline, about 0.25 Hz at 100 Hz
+#define WAVE_SPAN_DECAY (0.98f)    // autoscale, half-life about 1.4 s
+#define WAVE_MIN_SPAN (50.0f)
+// the panel moves the content over the next frame, about 9.3 ms at the
+// reset clock (0xD5 0x80, ~107 Hz), a column written sooner is moved too
+#define SCROLL_FRAME_MS (10)
+static volatile uint8_t wave = 0;
+static uint8_t wave_fresh;
+static uint32_t wave_cursor;
+static int64_t wave_since;  // older samples belong to an earlier measurement
+static float wave_dc;
+static float wave_span;
+static uint8_t wave_y;
+
+/**
+ * Power policy, run by SSD1306_task. The panel is bright for DIM_AFTER_US
+ * after the last SSD1306_wake, then dimmed, and switched off together with
+ * its charge pump at OFF_AFTER_US. Frames submitted while it is off wait in
+ * front until the next wake. The currents are rough figures for a 0.96"
+ * panel with a quarter of the pixels lit, only used for the estimate.
+ */
+#define DIM_AFTER_US (15000000LL)
+#define OFF_AFTER_US (30000000LL)
+#define CONTRAST_ON (0xCF)
+#define CONTRAST_DIM (0x08)
+#define ON_UA (8000)
+#define DIM_UA (2500)
+#define OFF_UA (10)
+static enum { power_off, power_dim, power_on } power = power_off;
+static volatile int64_t activity = 0;
+static volatile uint8_t forced_off = 0;
+static int64_t power_since = 0;
+static int64_t power_us[3];       // time spent in each power state
+static int64_t power_hour_us[3];  // power_us at hour_begin
+static uint32_t wake_latency = 0;
+
 static enum { ready, running, error } status = ready;
 
 #define fuse()                                 \
@@ -64,11 +166,441 @@ static enum { ready, running, error } status = ready;
         ESP_LOGE(TAG, "fuse at %d", __LINE__); \
     })
 
+/**
+ * @param[in] page 0 <= page <= 7
+ * @param[in] begin first column, 0 <= begin <= 127
+ * @param[in] end last column, begin <= end <= 127
+ */
+static inline void SSD1306_mark_dirty(uint8_t page,
+                                      uint8_t begin,
+                                      uint8_t end) {
+    if (begin < dirty_begin[page]) {
+        dirty_begin[page] = begin;
+    }
+    if (end > dirty_end[page]) {
+        dirty_end[page] = end;
+    }
+}
+
+static void SSD1306_clear_buffer() {
+    memset(buffer, 0, sizeof(uint8_t) * 1024);
+    for (uint8_t page = 0; page < 8; page++) {
+        SSD1306_mark_dirty(page, 0, 127);
+    }
+}
+
+/**
+ * @brief send the columns begin..end of pages first..last from gddram, the
+ * data must be contiguous, i.e. first == last or a full width window
+ */
+static esp_err_t SSD1306_transfer_range(uint8_t first,
+                                        uint8_t last,
+                                        uint8_t begin,
+                                        uint8_t end) {
+    uint8_t window[] = {0x21, COMD, begin, COMD, end,
+                        COMD, 0x22, COMD, first, COMD, last};
+    if (i2c_write(SSD1306, COMD, sizeof(window), window) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    frame_transactions++;
+    uint8_t* p = gddram + (first << 7) + begin;
+    uint16_t size = (last - first + 1) * (end - begin + 1);
+    uint16_t chunk = mode == SSD1306_MODE_CHUNK ? CHUNK_SIZE : size;
+    while (size) {
+        uint16_t len = size > chunk ? chunk : size;
+        if (i2c_write(SSD1306, DATA, len, p) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        frame_transactions++;
+        p += len;
+        size -= len;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief hand the back buffer over to SSD1306_task and return at once
+ */
+static void SSD1306_submit() {
+    if (status != running) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (pending) {
+        dropped++;
+    }
+    for (uint8_t page = 0; page < 8; page++) {
+        uint8_t begin = dirty_begin[page];
+        uint8_t end = dirty_end[page];
+        if (begin > end) {
+            continue;
+        }
+        uint16_t offset = (page << 7) + begin;
+        memcpy(front + offset, buffer + offset, end - begin + 1);
+        if (begin < front_begin[page]) {
+            front_begin[page] = begin;
+        }
+        if (end > front_end[page]) {
+            front_end[page] = end;
+        }
+        dirty_begin[page] = CLEAN_BEGIN;
+        dirty_end[page] = 0;
+    }
+    pending = 1;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(frame_ready);
+}
+
+/**
+ * @brief print gddram as a plain PBM image with its stats, so a frame can be
+ * cut from the log, viewed, and compared with a golden one by crc
+ */
+static void SSD1306_dump_frame() {
+    ESP_LOGI(TAG, "frame %u: %u bytes, %u transactions, crc %08x", frames,
+             frame_bytes, frame_transactions,
+             esp_crc32_le(0, gddram, sizeof(gddram)));
+    printf("P1\n128 64\n");
+    char line[129];
+    line[128] = '\0';
+    for (uint8_t y = 0; y < 64; y++) {
+        const uint8_t* page = gddram + ((y >> 3) << 7);
+        for (uint8_t x = 0; x < 128; x++) {
+            line[x] = page[x] & (1 << (y & 7)) ? '1' : '0';
+        }
+        printf("%s\n", line);
+    }
+}
+
+// a page is sent as up to MAX_RUNS column runs, a gap of more than RUN_GAP
+// unchanged columns costs more than the window command of a new run
+#define MAX_RUNS (4)
+#define RUN_GAP (12)
+
+/**
+ * @brief split the changed columns of one page into runs, so two digits far
+ * apart go out as two glyphs instead of the line between them
+ * @param[in] begin first changed column
+ * @param[in] end last changed column, begin <= end
+ * @return runs found, the last one reaches end
+ */
+static uint8_t SSD1306_split(const uint8_t* now,
+                             const uint8_t* old,
+                             uint8_t begin,
+                             uint8_t end,
+                             uint8_t* run_begin,
+                             uint8_t* run_end) {
+    uint8_t runs = 0;
+    uint8_t column = begin;
+    while (column <= end) {
+        uint8_t changed = column;  // last changed column of this run
+        uint8_t next = column + 1;
+        while (next <= end &&
+               (next - changed <= RUN_GAP || runs == MAX_RUNS - 1)) {
+            if (now[next] != old[next]) {
+                changed = next;
+            }
+            next++;
+        }
+        run_begin[runs] = column;
+        run_end[runs] = changed;
+        runs++;
+        while (next <= end && now[next] == old[next]) {
+            next++;
+        }
+        column = next;
+    }
+    return runs;
+}
+
+/**
+ * @brief push the changed part of front to GDDRAM to display it
+ */
+static void SSD1306_push() {
+    if (status != running) {
+        return;
+    }
+    uint8_t run_begin[8][MAX_RUNS];
+    uint8_t run_end[8][MAX_RUNS];
+    uint8_t runs[8] = {0};
+    uint8_t first = 8;
+    uint8_t last = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    pending = 0;
+    for (uint8_t page = 0; page < 8; page++) {
+        uint8_t begin = front_begin[page];
+        uint8_t end = front_end[page];
+        front_begin[page] = CLEAN_BEGIN;
+        front_end[page] = 0;
+        uint8_t* now = front + (page << 7);
+        uint8_t* old = gddram + (page << 7);
+        if (!gddram_valid) {
+            // content after power up is random
+            begin = 0;
+            end = 127;
+            run_begin[page][0] = begin;
+            run_end[page][0] = end;
+            runs[page] = 1;
+        } else if (begin <= end) {
+            while (begin <= end && now[begin] == old[begin]) {
+                begin++;
+            }
+            while (end > begin && now[end] == old[end]) {
+                end--;
+            }
+            if (begin <= end) {
+                runs[page] = SSD1306_split(now, old, begin, end,
+                                           run_begin[page], run_end[page]);
+            }
+        }
+        if (begin > end) {
+            continue;
+        }
+        memcpy(old + begin, now + begin, end - begin + 1);
+        if (first == 8) {
+            first = page;
+        }
+        last = page;
+    }
+    gddram_valid = 1;
+    xSemaphoreGive(lock);
+
+    uint16_t bytes = 0;
+    frame_transactions = 0;
+    if (mode == SSD1306_MODE_FRAME) {
+        // whole pages first..last in one go
+        if (first <= last) {
+            if (SSD1306_transfer_range(first, last, 0, 127) != ESP_OK) {
+                fuse();
+                return;
+            }
+            bytes = (last - first + 1) << 7;
+        }
+    } else {
+        for (uint8_t page = first; page <= last && page < 8; page++) {
+            for (uint8_t r = 0; r < runs[page]; r++) {
+                uint8_t begin = run_begin[page][r];
+                uint8_t end = run_end[page][r];
+                if (SSD1306_transfer_range(page, page, begin, end) !=
+                    ESP_OK) {
+                    fuse();
+                    return;
+                }
+                bytes += end - begin + 1;
+            }
+        }
+    }
+    frame_bytes = bytes;
+    ESP_LOGD(TAG, "frame %u/1024 bytes", frame_bytes);
+    if (bytes) {
+        frames++;
+        if (dump) {
+            SSD1306_dump_frame();
+        }
+    }
+}
+
+/**
+ * @brief rate limiter, wait until MIN_FRAME_MS passed since the last push
+ */
+static void SSD1306_limit() {
+    TickType_t min = MIN_FRAME_MS / portTICK_PERIOD_MS;
+    TickType_t passed = xTaskGetTickCount() - last_push;
+    if (passed < min) {
+        vTaskDelay(min - passed);
+    }
+    last_push = xTaskGetTickCount();
+}
+
+/**
+ * @brief plot the PPG samples since the last step as one new column at the
+ * right edge of the wave area
+ */
+static void SSD1306_wave_step() {
+    NAR_BUS_sample_t samples[WAVE_READ];
+    uint32_t n;
+    float sum = 0;
+    uint32_t count = 0;
+    while ((n = NAR_BUS_read(NAR_BUS_PPG, &wave_cursor, samples, WAVE_READ))) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (samples[i].time < wave_since) {
+                continue;
+            }
+            float x = samples[i].value[0];
+            if (wave_fresh) {
+                wave_dc = x;
+                wave_fresh = 0;
+            }
+            wave_dc += (x - wave_dc) * WAVE_DC_ALPHA;
+            // IR drops as blood volume rises, plot the pulse upwards
+            sum += wave_dc - x;
+            count++;
+        }
+    }
+    if (!count) {
+        return;
+    }
+    float v = sum / count;
+    wave_span *= WAVE_SPAN_DECAY;
+    if (fabsf(v) > wave_span) {
+        wave_span = fabsf(v);
+    }
+    if (wave_span < WAVE_MIN_SPAN) {
+        wave_span = WAVE_MIN_SPAN;
+    }
+    int16_t y = WAVE_HEIGHT / 2 - v * (WAVE_HEIGHT / 2 - 1) / wave_span;
+    if (y < 0) {
+        y = 0;
+    } else if (y > WAVE_HEIGHT - 1) {
+        y = WAVE_HEIGHT - 1;
+    }
+    // join to the previous point so fast edges stay visible
+    uint8_t column[WAVE_PAGES] = {0};
+    uint8_t top = y < wave_y ? y : wave_y;
+    uint8_t bottom = y < wave_y ? wave_y : y;
+    for (uint8_t i = top; i <= bottom; i++) {
+        column[i >> 3] |= 1 << (i & 7);
+    }
+    wave_y = y;
+
+    uint8_t scroll[] = {0x2D, COMD, 0x00, COMD, WAVE_FIRST_PAGE,
+                        COMD, 0x01, COMD, 0x07, COMD,
+                        0x00, COMD, 0x00, COMD, 0x7F};
+    uint8_t window[] = {0x21, COMD, 0x7F, COMD, 0x7F,
+                        COMD, 0x22, COMD, WAVE_FIRST_PAGE, COMD, 0x07};
+    if (i2c_write(SSD1306, COMD, sizeof(scroll), scroll) != ESP_OK) {
+        fuse();
+        return;
+    }
+    // a full tick more, vTaskDelay(1) may end at the very next tick
+    vTaskDelay(SCROLL_FRAME_MS / portTICK_PERIOD_MS + 1);
+    if (i2c_write(SSD1306, COMD, sizeof(window), window) != ESP_OK ||
+        i2c_write(SSD1306, DATA, WAVE_PAGES, column) != ESP_OK) {
+        fuse();
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (uint8_t p = 0; p < WAVE_PAGES; p++) {
+        uint8_t* line = gddram + ((WAVE_FIRST_PAGE + p) << 7);
+        memmove(line, line + 1, 127);
+        line[127] = column[p];
+    }
+    xSemaphoreGive(lock);
+}
+
+static const uint32_t power_ua[] = {OFF_UA, DIM_UA, ON_UA};
+
+/**
+ * @return estimated charge in uAh over the given time in each power state
+ */
+static uint32_t SSD1306_charge(const int64_t us[3]) {
+    int64_t sum = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        sum += us[i] * power_ua[i];
+    }
+    return sum / 3600000000LL;
+}
+
+/**
+ * @brief roll frames_per_hour and log the hourly display budget
+ */
+static void SSD1306_account(int64_t now) {
+    power_us[power] += now - power_since;
+    power_since = now;
+    if (now - hour_begin < HOUR_US) {
+        return;
+    }
+    int64_t hour_us[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        hour_us[i] = power_us[i] - power_hour_us[i];
+        power_hour_us[i] = power_us[i];
+    }
+    frames_per_hour = frames;
+    frames = 0;
+    hour_begin = now;
+    ESP_LOGI(TAG, "last hour: %u frames, on %llds, dim %llds, ~%u uAh",
+             frames_per_hour, hour_us[power_on] / 1000000,
+             hour_us[power_dim] / 1000000, SSD1306_charge(hour_us));
+}
+
+/**
+ * @brief apply wake / off requests and the dim and off timeouts
+ * @return ticks until the next timeout, portMAX_DELAY if none
+ */
+static TickType_t SSD1306_power_step() {
+    int64_t now = esp_timer_get_time();
+    SSD1306_account(now);
+    int64_t idle = now - activity;
+    uint8_t target = power_off;
+    int64_t left = 0;
+    if (!forced_off && idle < DIM_AFTER_US) {
+        target = power_on;
+        left = DIM_AFTER_US - idle;
+    } else if (!forced_off && idle < OFF_AFTER_US) {
+        target = power_dim;
+        left = OFF_AFTER_US - idle;
+    }
+    if (target != power) {
+        uint8_t contrast = target == power_on ? CONTRAST_ON : CONTRAST_DIM;
+        uint8_t off[] = {0xAE, COMD, 0x8D, COMD, 0x10};
+        uint8_t on[] = {0x8D, COMD, 0x14,     COMD, 0x81,
+                        COMD, contrast, COMD, 0xAF};
+        uint8_t dim[] = {0x81, COMD, contrast};
+        esp_err_t ret;
+        if (target == power_off) {
+            ret = i2c_write(SSD1306, COMD, sizeof(off), off);
+        } else if (power == power_off) {
+            ret = i2c_write(SSD1306, COMD, sizeof(on), on);
+        } else {
+            ret = i2c_write(SSD1306, COMD, sizeof(dim), dim);
+        }
+        if (ret != ESP_OK) {
+            fuse();
+            return portMAX_DELAY;
+        }
+        if (target == power_on) {
+            wake_latency = esp_timer_get_time() - activity;
+            ESP_LOGI(TAG, "lit %u us after wake", wake_latency);
+        }
+        power = target;
+    }
+    if (target == power_off) {
+        return portMAX_DELAY;
+    }
+    return left / 1000 / portTICK_PERIOD_MS + 1;
+}
+
+static void SSD1306_task(void* pvParameters) {
+    TickType_t last = xTaskGetTickCount();
+    TickType_t wait = portMAX_DELAY;
+    while (status == running) {
+        // frames still go out between wave steps
+        uint8_t plot = wave && power != power_off;
+        TickType_t period = WAVE_PERIOD_MS / portTICK_PERIOD_MS;
+        TickType_t passed = xTaskGetTickCount() - last;
+        if (plot && passed < period && period - passed < wait) {
+            wait = period - passed;
+        } else if (plot && passed >= period) {
+            wait = 0;
+        }
+        xSemaphoreTake(frame_ready, wait);
+        wait = SSD1306_power_step();
+        if (power != power_off && pending) {
+            SSD1306_limit();
+            SSD1306_push();
+        }
+        if (plot && xTaskGetTickCount() - last >= period) {
+            last = xTaskGetTickCount();
+            SSD1306_wave_step();
+        }
+    }
+    vTaskDelete(NULL);
+}
+
 void SSD1306_init() {
     if (status != ready) {
         return;
     }
-    uint8_t init[] = {0x8D, COMD, 0x14, COMD, 0xAE, COMD, 0x20,
+    uint8_t init[] = {0x8D, COMD, 0x10, COMD, 0xAE, COMD, 0x20,
                       COMD, 0x00, COMD, 0x21, COMD, 0x00, COMD,
                       0x7F, COMD, 0x22, COMD, 0x00, COMD, 0x07};
     esp_err_t ret = i2c_write(SSD1306, COMD, 21, init);
@@ -76,26 +608,89 @@ void SSD1306_init() {
         fuse();
         return;
     }
+    SSD1306_clear_buffer();
+    for (uint8_t page = 0; page < 8; page++) {
+        front_begin[page] = CLEAN_BEGIN;
+        front_end[page] = 0;
+    }
+    lock = xSemaphoreCreateMutex();
+    frame_ready = xSemaphoreCreateBinary();
+    if (!lock || !frame_ready) {
+        fuse();
+        return;
+    }
     status = running;
+    if (benchmark) {
+        // nothing else renders or pushes before SSD1306_task starts
+        SSD1306_run_benchmark();
+    }
+    TaskHandle_t xHandle = NULL;
+    xTaskCreate(SSD1306_task, "ssd1306", STACK_SIZE, NULL,
+                tskIDLE_PRIORITY + 2, &xHandle);
+    if (!xHandle) {
+        fuse();
+        return;
+    }
     ESP_LOGI(TAG, "ssd1306 init");
 }
 
 /**
- * @brief push buffer to GDDRAM to display it
+ * @return bytes sent by the last frame, at most 1024
  */
-static void SSD1306_transfer_buffer() {
-    if (status != running) {
-        return;
-    }
-    uint8_t* p = buffer;
-    for (uint8_t i = 0; i < 64; i++) {
-        if (i2c_write(SSD1306, DATA, 16, p) != ESP_OK) {
-            fuse();
-            return;
-        }
-        p += 16;
-    }
-    memset(buffer, 0, sizeof(uint8_t) * 1024);
+uint16_t SSD1306_get_frame_bytes() {
+    return frame_bytes;
+}
+
+/**
+ * @return I2C transactions of the last frame
+ */
+uint16_t SSD1306_get_frame_transactions() {
+    return frame_transactions;
+}
+
+/**
+ * @return crc32 of the displayed content, equal for pixel-identical frames
+ */
+uint32_t SSD1306_get_frame_crc() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t crc = esp_crc32_le(0, gddram, sizeof(gddram));
+    xSemaphoreGive(lock);
+    return crc;
+}
+
+/**
+ * @brief print every frame that changes the screen to the log as PBM
+ * @param[in] on_off
+ * | 1 - on
+ * | 0 - off
+ */
+void SSD1306_set_dump(uint8_t on_off) {
+    dump = on_off;
+}
+
+/**
+ * @return frames that changed the screen in the last full hour, or so far
+ * in the first hour
+ */
+uint32_t SSD1306_get_frames_per_hour() {
+    return hour_begin ? frames_per_hour : frames;
+}
+
+/**
+ * @return frames replaced by a newer one before they were sent
+ */
+uint32_t SSD1306_get_dropped_frames() {
+    return dropped;
+}
+
+/**
+ * @param[in] new_mode
+ * | SSD1306_MODE_CHUNK - 16 bytes per transaction
+ * | SSD1306_MODE_PAGE - one transaction per changed page
+ * | SSD1306_MODE_FRAME - one transaction for all changed pages
+ */
+void SSD1306_set_mode(SSD1306_mode_t new_mode) {
+    mode = new_mode;
 }
 
 /**
@@ -116,119 +711,357 @@ static void SSD1306_transfer_buffer() {
 static void SSD1306_set_pixel(uint8_t x, uint8_t y) {
     if (x <= 127 && y <= 63) {
         buffer[((y & 0xf8) << 4) + x] |= 1 << (y & 7);
+        SSD1306_mark_dirty(y >> 3, x, x);
     } else {
         ESP_LOGW(TAG, "set_pixel out of range");
     }
 }
 
 /**
- * @brief print a character (or image) in buffer
- * @param[in] row number of rows occupied by character, 1 row == 8 bits == 1
- * byte, 1 <= row <= 8
- * @param[in] col Number of columns occupied by character, 1 col == 1 bit, 1 <=
- * col <= 128
- * @param[in] font font of character
- * @param[in] offset begin position (index of buffer), 0 <= offset <= 1023
+ * @brief copy an image into buffer, clipped to the screen once, then one
+ * memcpy per page
+ * @param[in] row height in pages, 1 <= row <= 8
+ * @param[in] col width in columns, 1 <= col <= 128
+ * @param[in] image row * col bytes, page by page (see font.h)
+ * @param[in] page top page, 0 <= page <= 7
+ * @param[in] x left column, may be out of screen
  */
-static void SSD1306_set_char(uint8_t row,
-                             uint8_t col,
-                             const uint8_t font[],
-                             uint16_t offset) {
-    uint16_t index = 0;
-    for (uint16_t c = 0; c < col; c++) {
-        for (uint16_t r = 0; r < row; r++) {
-            uint16_t temp = offset + (r << 7) + c;
-            if (temp > 1023) {
-                ESP_LOGW(TAG, "set_char out of range");
-                return;
-            }
-            buffer[temp] = font[index++];
+static void SSD1306_blit(uint8_t row,
+                         uint8_t col,
+                         const uint8_t* image,
+                         uint8_t page,
+                         int16_t x) {
+    int16_t begin = x < 0 ? -x : 0;
+    int16_t end = x + col > 128 ? 128 - x : col;
+    if (begin >= end || page > 7) {
+        return;
+    }
+    if (page + row > 8) {
+        row = 8 - page;
+    }
+    uint8_t* dst = buffer + (page << 7) + x + begin;
+    const uint8_t* src = image + begin;
+    for (uint8_t r = 0; r < row; r++) {
+        memcpy(dst, src, end - begin);
+        SSD1306_mark_dirty(page + r, x + begin, x + end - 1);
+        dst += 128;
+        src += col;
+    }
+}
+
+/**
+ * @brief draw text, a character not in font is left blank
+ * @param[in] x left column of the first character
+ * @return x after the last character
+ */
+static int16_t SSD1306_text(const font_t* font,
+                            uint8_t page,
+                            int16_t x,
+                            const char* text) {
+    for (; *text; text++) {
+        const char* found = strchr(font->chars, *text);
+        if (found) {
+            SSD1306_blit(font->row, font->col, font->glyph[found - font->chars],
+                         page, x);
         }
+        x += font->col;
     }
+    return x;
+}
+
+/**
+ * @param[in] end column after the last character
+ */
+static void SSD1306_text_right(const font_t* font,
+                               uint8_t page,
+                               int16_t end,
+                               const char* text) {
+    SSD1306_text(font, page, end - strlen(text) * font->col, text);
+}
+
+/**
+ * @brief light the display at full contrast and restart the dim / off
+ * timeouts, for user activity such as button, tap or raise
+ * @param[in] time when the activity happened, us, for the wake latency
+ */
+void SSD1306_wake_at(int64_t time) {
+    if (status != running) {
+        return;
+    }
+    activity = time;
+    forced_off = 0;
+    xSemaphoreGive(frame_ready);
+}
+
+void SSD1306_wake() {
+    SSD1306_wake_at(esp_timer_get_time());
+}
+
+/**
+ * @return us from the activity to the panel lit, of the last wake that had
+ * to light it
+ */
+uint32_t SSD1306_get_wake_latency() {
+    return wake_latency;
 }
 
 /**
  * @brief set display on/off
  * @param[in] on_off
- * | 1 - on
- * | 0 - off
+ * | 1 - on, same as SSD1306_wake
+ * | 0 - off until the next wake
  */
 void SSD1306_set_display(uint8_t on_off) {
     if (status != running) {
         return;
     }
     if (on_off) {
-        if (i2c_write(SSD1306, COMD, 1, (uint8_t[]){0xAF}) != ESP_OK) {
-            fuse();
-        }
+        SSD1306_wake();
     } else {
-        if (i2c_write(SSD1306, COMD, 1, (uint8_t[]){0xAE}) != ESP_OK) {
-            fuse();
-        }
+        forced_off = 1;
+        xSemaphoreGive(frame_ready);
     }
 }
 
-static void display_header(uint8_t wifi) {
-    uint64_t min = esp_timer_get_time() / 60000000;
-    uint16_t hour = min / 60;
-    min %= 60;
-    SSD1306_set_char(2, 8, font_num_2_8[hour / 10 % 10], 0);
-    SSD1306_set_char(2, 8, font_num_2_8[hour % 10], 8);
-    SSD1306_set_char(2, 8, font_mao_2_8, 16);
-    SSD1306_set_char(2, 8, font_num_2_8[min / 10], 24);
-    SSD1306_set_char(2, 8, font_num_2_8[min % 10], 32);
-    if (wifi) {
-        SSD1306_set_char(2, 16, font_wifi_2_16, 80);
-    }
-    SSD1306_set_char(2, 31, font_battery_2_31, 96);
-    for (int i = 0; i < 128; i++) {
-        SSD1306_set_pixel(i, 15);
+/**
+ * @return seconds the display was lit, bright or dimmed
+ */
+uint32_t SSD1306_get_on_time() {
+    return (power_us[power_on] + power_us[power_dim]) / 1000000;
+}
+
+/**
+ * @return estimated charge used by the display since boot, uAh
+ */
+uint32_t SSD1306_get_charge() {
+    return SSD1306_charge(power_us);
+}
+
+/**
+ * @brief a retained UI element. It is only re-rendered when the value bound
+ * to it changes, so an update touches just the bytes of changed widgets.
+ */
+typedef struct widget {
+    uint16_t offset;  // buffer index of the top left byte
+    uint8_t row;      // height in pages
+    uint8_t col;      // width in columns
+    void (*draw)(const struct widget* w, int32_t value);
+    const void* data;  // image or glyph list of static widgets
+    int32_t value;     // value on screen, STALE if none
+} widget_t;
+
+#define STALE (INT32_MIN)
+#define STEP_MAX (99999)
+
+static void SSD1306_clear_rect(uint16_t offset, uint8_t row, uint8_t col) {
+    for (uint8_t r = 0; r < row; r++) {
+        uint16_t begin = offset + (r << 7);
+        memset(buffer + begin, 0, col);
+        SSD1306_mark_dirty(begin >> 7, begin & 127, (begin & 127) + col - 1);
     }
 }
 
-void SSD1306_display_main_menu(unsigned long step, double temp, uint8_t wifi) {
-    if (status != running) {
-        return;
+/**
+ * @brief redraw the header rule (pixel row 15) below a header widget
+ */
+static void SSD1306_set_rule(const widget_t* w) {
+    for (uint8_t c = 0; c < w->col; c++) {
+        SSD1306_set_pixel((w->offset & 127) + c, 15);
     }
-    display_header(wifi);
-    SSD1306_set_char(3, 24, font_step_3_24, 256);
-    SSD1306_set_char(2, 8, font_S_2_8, 408);
-    SSD1306_set_char(2, 8, font_T_2_8, 416);
-    SSD1306_set_char(2, 8, font_E_2_8, 424);
-    SSD1306_set_char(2, 8, font_P_2_8, 432);
-    SSD1306_set_char(3, 24, font_temp_3_24, 320);
-    SSD1306_set_char(2, 8, font_T_2_8, 472);
-    SSD1306_set_char(2, 8, font_E_2_8, 480);
-    SSD1306_set_char(2, 8, font_M_2_8, 488);
-    SSD1306_set_char(2, 8, font_P_2_8, 496);
-    if (step <= 99999) {
-        uint8_t index = 0;
-        do {
-            SSD1306_set_char(3, 12, font_num_3_12[step % 10],
-                             688 - 12 * index++);
-            step /= 10;
-        } while (step != 0);
+}
+
+#define PAGE(w) ((w)->offset >> 7)
+#define X(w) ((w)->offset & 127)
+
+static void draw_image(const widget_t* w, int32_t value) {
+    SSD1306_blit(w->row, w->col, w->data, PAGE(w), X(w));
+}
+
+static void draw_header_image(const widget_t* w, int32_t value) {
+    draw_image(w, value);
+    SSD1306_set_rule(w);
+}
+
+/**
+ * @brief data is the text in font_2_8
+ */
+static void draw_label(const widget_t* w, int32_t value) {
+    SSD1306_text(&font_2_8, PAGE(w), X(w), w->data);
+}
+
+/**
+ * @param[in] value minutes since boot
+ */
+static void draw_clock(const widget_t* w, int32_t value) {
+    char text[8];
+    sprintf(text, "%02d:%02d", (int)(value / 60 % 100), (int)(value % 60));
+    SSD1306_text(&font_2_8, PAGE(w), X(w), text);
+    SSD1306_set_rule(w);
+}
+
+static void draw_wifi(const widget_t* w, int32_t value) {
+    if (value) {
+        SSD1306_blit(2, 16, font_wifi_2_16, PAGE(w), X(w));
+    }
+    SSD1306_set_rule(w);
+}
+
+/**
+ * @param[in] value step, STEP_MAX + 1 if more
+ */
+static void draw_step(const widget_t* w, int32_t value) {
+    if (value <= STEP_MAX) {
+        char text[8];
+        sprintf(text, "%d", (int)value);
+        SSD1306_text_right(&font_3_12, PAGE(w), X(w) + 60, text);
     } else {
-        SSD1306_set_char(3, 12, font_plus_3_12, 700);
-        for (int i = 0; i < 5; i++) {
-            SSD1306_set_char(3, 12, font_num_3_12[9], 688 - 12 * i);
-        }
+        SSD1306_text(&font_3_12, PAGE(w), X(w), "99999+");
+    }
+}
+
+/**
+ * @param[in] value temperature in 0.1 degree
+ */
+static void draw_temp(const widget_t* w, int32_t value) {
+    char text[8];
+    sprintf(text, "%02d.%d", (int)(value / 10 % 100), (int)(value % 10));
+    SSD1306_text(&font_3_12, PAGE(w), X(w), text);
+}
+
+/**
+ * @param[in] value type << 8 | hr, type 1 or 2, see SSD1306_display_hr
+ */
+static void draw_hr(const widget_t* w, int32_t value) {
+    uint8_t type = value >> 8;
+    if (type == 1) {
+        char text[4];
+        sprintf(text, "%02d", (int)(value & 0xFF));
+        SSD1306_text_right(&font_3_12, PAGE(w), X(w) + 36, text);
+    } else {
+        SSD1306_blit(3, 24, font_fail_3_24, PAGE(w), X(w));
+    }
+}
+
+enum {
+    W_CLOCK,
+    W_WIFI,
+    W_BATTERY,
+    W_STEP_ICON,
+    W_STEP_LABEL,
+    W_STEP,
+    W_TEMP_ICON,
+    W_TEMP_LABEL,
+    W_TEMP,
+    W_HR_ICON,
+    W_HR,
+    W_COUNT
+};
+
+static widget_t widgets[W_COUNT] = {
+    [W_CLOCK] = {0, 2, 40, draw_clock, NULL, STALE},
+    [W_WIFI] = {80, 2, 16, draw_wifi, NULL, STALE},
+    [W_BATTERY] = {96, 2, 31, draw_header_image, font_battery_2_31, STALE},
+    [W_STEP_ICON] = {256, 3, 24, draw_image, font_step_3_24, STALE},
+    [W_STEP_LABEL] = {408, 2, 32, draw_label, "STEP", STALE},
+    [W_STEP] = {640, 3, 72, draw_step, NULL, STALE},
+    [W_TEMP_ICON] = {320, 3, 24, draw_image, font_temp_3_24, STALE},
+    [W_TEMP_LABEL] = {472, 2, 32, draw_label, "TEMP", STALE},
+    [W_TEMP] = {720, 3, 48, draw_temp, NULL, STALE},
+    [W_HR_ICON] = {416, 3, 24, draw_image, font_hr_3_24, STALE},
+    [W_HR] = {456, 3, 36, draw_hr, NULL, STALE},
+};
+
+static enum {
+    screen_none,
+    screen_main,
+    screen_hr,
+    screen_wave
+} screen = screen_none;
+
+static void SSD1306_update(uint8_t id, int32_t value) {
+    widget_t* w = widgets + id;
+    if (w->value == value) {
+        return;
+    }
+    w->value = value;
+    SSD1306_clear_rect(w->offset, w->row, w->col);
+    w->draw(w, value);
+}
+
+/**
+ * @brief start from a blank buffer if the screen changes
+ */
+static void SSD1306_show(uint8_t id) {
+    if (screen == id) {
+        return;
+    }
+    screen = id;
+    SSD1306_clear_buffer();
+    for (uint8_t i = 0; i < W_COUNT; i++) {
+        widgets[i].value = STALE;
+    }
+    for (int i = 0; i < 128; i++) {
+        SSD1306_set_pixel(i, 15);
     }
+}
+
+static void display_header(uint8_t wifi) {
+    SSD1306_update(W_CLOCK, esp_timer_get_time() / 60000000);
+    SSD1306_update(W_WIFI, wifi);
+    SSD1306_update(W_BATTERY, 0);
+}
+
+static void render_main_menu(unsigned long step, double temp, uint8_t wifi) {
+    wave = 0;
+    SSD1306_show(screen_main);
+    display_header(wifi);
+    SSD1306_update(W_STEP_ICON, 0);
+    SSD1306_update(W_STEP_LABEL, 0);
+    SSD1306_update(W_TEMP_ICON, 0);
+    SSD1306_update(W_TEMP_LABEL, 0);
+    SSD1306_update(W_STEP, step <= STEP_MAX ? step : STEP_MAX + 1);
     temp *= 10;
     uint16_t foo = (uint16_t)temp;
     if (temp - foo >= 0.5) {
         foo++;
     }
-    SSD1306_set_char(3, 12, font_num_3_12[foo / 100 % 10], 720);
-    SSD1306_set_char(3, 12, font_num_3_12[foo / 10 % 10], 732);
-    SSD1306_set_char(3, 12, font_num_3_12[foo % 10], 756);
-    SSD1306_set_char(3, 12, font_dot_3_12, 744);
-    SSD1306_transfer_buffer();
+    SSD1306_update(W_TEMP, foo);
+}
+
+/**
+ * @brief header above a live PPG waveform, plotted by SSD1306_task
+ */
+static void render_wave(uint8_t wifi) {
+    if (screen != screen_wave) {
+        wave_fresh = 1;
+        wave_since = esp_timer_get_time();
+        wave_span = WAVE_MIN_SPAN;
+        wave_y = WAVE_HEIGHT / 2;
+    }
+    SSD1306_show(screen_wave);
+    display_header(wifi);
+    wave = 1;
+}
+
+static void render_hr(uint8_t type, uint8_t hr, uint8_t wifi) {
+    wave = 0;
+    SSD1306_show(screen_hr);
+    display_header(wifi);
+    SSD1306_update(W_HR_ICON, 0);
+    SSD1306_update(W_HR, type << 8 | (type == 1 ? hr : 0));
+}
+
+void SSD1306_display_main_menu(unsigned long step, double temp, uint8_t wifi) {
+    if (status != running) {
+        return;
+    }
+    render_main_menu(step, temp, wifi);
+    SSD1306_submit();
 }
 
 /**
  * @param[in] type
- * | 0 - waiting
+ * | 0 - waiting, shows the live PPG waveform until the next call
  * | 1 - success
  * | 2 - fail
  */
@@ -236,20 +1069,66 @@ void SSD1306_display_hr(uint8_t type, uint8_t hr, uint8_t wifi) {
     if (status != running) {
         return;
     }
-    display_header(wifi);
-    SSD1306_set_char(3, 24, font_hr_3_24, 416);
     if (type == 0) {
-        for (int i = 0; i < 3; i++) {
-            SSD1306_set_char(3, 12, font_dot_3_12, 456 + i * 12);
+        render_wave(wifi);
+    } else {
+        render_hr(type, hr, wifi);
+    }
+    SSD1306_submit();
+}
+
+/**
+ * @brief time a full render of each screen, and full frame pushes of every
+ * mode at 100 kHz and 400 kHz, the result goes to log. Call it before
+ * SSD1306_init(), which runs it before SSD1306_task starts. It holds
+ * I2C_PORT for about a second, so call that before anything else uses the
+ * bus.
+ */
+void SSD1306_benchmark() {
+    if (status != ready) {
+        ESP_LOGW(TAG, "benchmark after init, skipped");
+        return;
+    }
+    benchmark = 1;
+}
+
+static void SSD1306_run_benchmark() {
+    static const uint32_t freq[] = {100000, 400000};
+    static const char* name[] = {"chunk", "page", "frame"};
+    int64_t render[2] = {0, 0};
+    for (uint8_t i = 0; i < BENCHMARK_ROUNDS; i++) {
+        // switching screens every time re-renders every widget
+        int64_t begin = esp_timer_get_time();
+        render_main_menu(88888, 36.5, 1);
+        render[0] += esp_timer_get_time() - begin;
+        begin = esp_timer_get_time();
+        render_hr(1, 188, 1);
+        render[1] += esp_timer_get_time() - begin;
+    }
+    screen = screen_none;
+    ESP_LOGI(TAG, "render main menu: %lld us, hr: %lld us",
+             render[0] / BENCHMARK_ROUNDS, render[1] / BENCHMARK_ROUNDS);
+
+    SSD1306_mode_t old_mode = mode;
+    for (uint8_t f = 0; f < 2; f++) {
+        if (i2c_set_freq(freq[f]) != ESP_OK) {
+            ESP_LOGW(TAG, "benchmark can't set %u Hz", freq[f]);
+            continue;
         }
-    } else if (type == 1) {
-        SSD1306_set_char(3, 12, font_num_3_12[hr % 10], 480);
-        SSD1306_set_char(3, 12, font_num_3_12[hr / 10 % 10], 468);
-        if (hr > 99) {
-            SSD1306_set_char(3, 12, font_num_3_12[hr / 100], 456);
+        for (uint8_t m = SSD1306_MODE_CHUNK; m <= SSD1306_MODE_FRAME; m++) {
+            mode = m;
+            int64_t sum = 0;
+            for (uint8_t i = 0; i < BENCHMARK_ROUNDS; i++) {
+                gddram_valid = 0;
+                int64_t begin = esp_timer_get_time();
+                SSD1306_push();
+                sum += esp_timer_get_time() - begin;
+            }
+            ESP_LOGI(TAG, "%u Hz %s: %lld us/frame, %u bytes, %u transactions",
+                     freq[f], name[m], sum / BENCHMARK_ROUNDS, frame_bytes,
+                     frame_transactions);
         }
-    } else {
-        SSD1306_set_char(3, 24, font_fail_3_24, 456);
     }
-    SSD1306_transfer_buffer();
-}
\ No newline at end of file
+    i2c_set_freq(I2C_DEFAULT_FREQ);
+    mode = old_mode;
+}
@@ -10,9 +10,28 @@
 
 #include "esp_types.h"
 
+typedef enum {
+    SSD1306_MODE_CHUNK,
+    SSD1306_MODE_PAGE,
+    SSD1306_MODE_FRAME
+} SSD1306_mode_t;
+
 void SSD1306_init();
+void SSD1306_set_mode(SSD1306_mode_t new_mode);
+void SSD1306_benchmark();
 void SSD1306_set_display(uint8_t on_off);
+void SSD1306_wake();
+void SSD1306_wake_at(int64_t time);
+uint32_t SSD1306_get_wake_latency();
+uint32_t SSD1306_get_on_time();
+uint32_t SSD1306_get_charge();
 void SSD1306_display_main_menu(unsigned long step, double temp, uint8_t wifi);
 void SSD1306_display_hr(uint8_t type, uint8_t hr, uint8_t wifi);
+uint16_t SSD1306_get_frame_bytes();
+uint16_t SSD1306_get_frame_transactions();
+uint32_t SSD1306_get_frame_crc();
+void SSD1306_set_dump(uint8_t on_off);
+uint32_t SSD1306_get_dropped_frames();
+uint32_t SSD1306_get_frames_per_hour();
 
 #endif
@@ -1,6 +1,7 @@
 /**
  * @file font.h
- * @brief font data
+ * @brief font data. A glyph named _row_col is stored page by page, i.e. col
+ * bytes of its top page, then col bytes of the next page and so on.
  * @author Narukara
  * @date 2021.2
  */
@@ -9,155 +10,184 @@
 
 #include "esp_types.h"
 
-const uint8_t font_B_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0x88, 0x20, 0x88, 0x20,
-                              0x88, 0x20, 0x70, 0x11, 0x00, 0x0E, 0x00, 0x00};
+const uint8_t font_B_2_8[] = {
+    0x08, 0xF8, 0x88, 0x88, 0x88, 0x70, 0x00, 0x00, 0x20, 0x3F, 0x20, 0x20,
+    0x20, 0x11, 0x0E, 0x00};
 
-const uint8_t font_U_2_8[] = {0x08, 0x00, 0xF8, 0x1F, 0x08, 0x20, 0x00, 0x20,
-                              0x00, 0x20, 0x08, 0x20, 0xF8, 0x1F, 0x08, 0x00};
+const uint8_t font_U_2_8[] = {
+    0x08, 0xF8, 0x08, 0x00, 0x00, 0x08, 0xF8, 0x08, 0x00, 0x1F, 0x20, 0x20,
+    0x20, 0x20, 0x1F, 0x00};
 
-const uint8_t font_A_2_8[] = {0x00, 0x20, 0x00, 0x3C, 0xC0, 0x23, 0x38, 0x02,
-                              0xE0, 0x02, 0x00, 0x27, 0x00, 0x38, 0x00, 0x20};
+const uint8_t font_A_2_8[] = {
+    0x00, 0x00, 0xC0, 0x38, 0xE0, 0x00, 0x00, 0x00, 0x20, 0x3C, 0x23, 0x02,
+    0x02, 0x27, 0x38, 0x20};
 
-const uint8_t font_N_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0x30, 0x20, 0xC0, 0x00,
-                              0x00, 0x07, 0x08, 0x18, 0xF8, 0x3F, 0x08, 0x00};
+const uint8_t font_N_2_8[] = {
+    0x08, 0xF8, 0x30, 0xC0, 0x00, 0x08, 0xF8, 0x08, 0x20, 0x3F, 0x20, 0x00,
+    0x07, 0x18, 0x3F, 0x00};
 
-const uint8_t font_D_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0x08, 0x20, 0x08, 0x20,
-                              0x08, 0x20, 0x10, 0x10, 0xE0, 0x0F, 0x00, 0x00};
+const uint8_t font_D_2_8[] = {
+    0x08, 0xF8, 0x08, 0x08, 0x08, 0x10, 0xE0, 0x00, 0x20, 0x3F, 0x20, 0x20,
+    0x20, 0x10, 0x0F, 0x00};
 
-const uint8_t font_S_2_8[] = {0x00, 0x00, 0x70, 0x38, 0x88, 0x20, 0x08, 0x21,
-                              0x08, 0x21, 0x08, 0x22, 0x38, 0x1C, 0x00, 0x00};
+const uint8_t font_S_2_8[] = {
+    0x00, 0x70, 0x88, 0x08, 0x08, 0x08, 0x38, 0x00, 0x00, 0x38, 0x20, 0x21,
+    0x21, 0x22, 0x1C, 0x00};
 
-const uint8_t font_T_2_8[] = {0x18, 0x00, 0x08, 0x00, 0x08, 0x20, 0xF8, 0x3F,
-                              0x08, 0x20, 0x08, 0x00, 0x18, 0x00, 0x00, 0x00};
+const uint8_t font_T_2_8[] = {
+    0x18, 0x08, 0x08, 0xF8, 0x08, 0x08, 0x18, 0x00, 0x00, 0x00, 0x20, 0x3F,
+    0x20, 0x00, 0x00, 0x00};
 
-const uint8_t font_E_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0x88, 0x20, 0x88, 0x20,
-                              0xE8, 0x23, 0x08, 0x20, 0x10, 0x18, 0x00, 0x00};
+const uint8_t font_E_2_8[] = {
+    0x08, 0xF8, 0x88, 0x88, 0xE8, 0x08, 0x10, 0x00, 0x20, 0x3F, 0x20, 0x20,
+    0x23, 0x20, 0x18, 0x00};
 
-const uint8_t font_M_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0xF8, 0x01, 0x00, 0x3E,
-                              0xF8, 0x01, 0xF8, 0x3F, 0x08, 0x20, 0x00, 0x00};
+const uint8_t font_M_2_8[] = {
+    0x08, 0xF8, 0xF8, 0x00, 0xF8, 0xF8, 0x08, 0x00, 0x20, 0x3F, 0x01, 0x3E,
+    0x01, 0x3F, 0x20, 0x00};
 
-const uint8_t font_P_2_8[] = {0x08, 0x20, 0xF8, 0x3F, 0x08, 0x21, 0x08, 0x01,
-                              0x08, 0x01, 0x08, 0x01, 0xF0, 0x00, 0x00, 0x00};
+const uint8_t font_P_2_8[] = {
+    0x08, 0xF8, 0x08, 0x08, 0x08, 0x08, 0xF0, 0x00, 0x20, 0x3F, 0x21, 0x01,
+    0x01, 0x01, 0x00, 0x00};
 
 const uint8_t font_step_3_24[] = {
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x07,
-    0x00, 0x30, 0x07, 0x00, 0x7C, 0x0E, 0x00, 0x3E, 0x0E, 0x00, 0x1F, 0x0E,
-    0x80, 0x87, 0x0F, 0x80, 0xE3, 0x0F, 0x80, 0xFF, 0x07, 0x80, 0xFF, 0x01,
-    0x98, 0xDF, 0x01, 0xBC, 0xC7, 0x01, 0x3C, 0xC7, 0x0F, 0x3C, 0x8F, 0x7F,
-    0x18, 0x0E, 0x7F, 0x00, 0x0E, 0x78, 0x00, 0x0E, 0x00, 0x00, 0x0E, 0x00,
-    0x00, 0x0E, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80,
+    0x98, 0xBC, 0x3C, 0x3C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x30, 0x7C, 0x3E, 0x1F, 0x87, 0xE3, 0xFF, 0xFF,
+    0xDF, 0xC7, 0xC7, 0x8F, 0x0E, 0x0E, 0x0E, 0x0E, 0x0E, 0x06, 0x00, 0x00,
+    0x00, 0x00, 0x07, 0x07, 0x07, 0x0E, 0x0E, 0x0E, 0x0F, 0x0F, 0x07, 0x01,
+    0x01, 0x01, 0x0F, 0x7F, 0x7F, 0x78, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t font_temp_3_24[] = {
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00,
-    0x14, 0x00, 0x00, 0x08, 0x00, 0x00, 0x70, 0x00, 0x60, 0x88, 0x00, 0x38,
-    0x88, 0xE0, 0x1F, 0x88, 0x10, 0x04, 0x00, 0x8C, 0x05, 0x00, 0xF2, 0x05,
-    0x80, 0xF1, 0x04, 0x40, 0x7C, 0x03, 0x30, 0x9F, 0x00, 0x88, 0x6F, 0x00,
-    0xE4, 0x13, 0x00, 0xE4, 0x0D, 0x00, 0x64, 0x02, 0x00, 0x84, 0x01, 0x00,
-    0x7C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    0x00, 0x00, 0x00, 0x08, 0x14, 0x08, 0x70, 0x88, 0x88, 0x88, 0x00, 0x00,
+    0x80, 0x40, 0x30, 0x88, 0xE4, 0xE4, 0x64, 0x84, 0x7C, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0x10, 0x8C, 0xF2,
+    0xF1, 0x7C, 0x9F, 0x6F, 0x13, 0x0D, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x38, 0x1F, 0x04, 0x05, 0x05,
+    0x04, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t font_hr_3_24[] = {
-    0x80, 0x03, 0x00, 0xE0, 0x07, 0x00, 0xF0, 0x27, 0x00, 0xF8, 0x67, 0x00,
-    0xF8, 0xE7, 0x00, 0xFC, 0xE7, 0x01, 0xFC, 0xE7, 0x03, 0xFC, 0x8F, 0x07,
-    0xF8, 0x8F, 0x0F, 0xF8, 0xE3, 0x1F, 0xF0, 0xE1, 0x3F, 0xE0, 0x03, 0x7F,
-    0xE0, 0x1F, 0x7E, 0xF0, 0x0F, 0x3F, 0xF8, 0xC1, 0x1F, 0x38, 0xF0, 0x0F,
-    0x3C, 0xF8, 0x07, 0xFC, 0xE1, 0x03, 0xFC, 0xE7, 0x01, 0xFC, 0xE7, 0x00,
-    0xF8, 0x67, 0x00, 0xF0, 0x27, 0x00, 0xE0, 0x07, 0x00, 0x80, 0x03, 0x00};
+    0x80, 0xE0, 0xF0, 0xF8, 0xF8, 0xFC, 0xFC, 0xFC, 0xF8, 0xF8, 0xF0, 0xE0,
+    0xE0, 0xF0, 0xF8, 0x38, 0x3C, 0xFC, 0xFC, 0xFC, 0xF8, 0xF0, 0xE0, 0x80,
+    0x03, 0x07, 0x27, 0x67, 0xE7, 0xE7, 0xE7, 0x8F, 0x8F, 0xE3, 0xE1, 0x03,
+    0x1F, 0x0F, 0xC1, 0xF0, 0xF8, 0xE1, 0xE7, 0xE7, 0x67, 0x27, 0x07, 0x03,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x07, 0x0F, 0x1F, 0x3F, 0x7F,
+    0x7E, 0x3F, 0x1F, 0x0F, 0x07, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t font_fail_3_24[] = {
-    0x00, 0x00, 0x00, 0x00, 0x7E, 0x00, 0x80, 0x81, 0x03, 0x60, 0x00, 0x0C,
-    0x30, 0x00, 0x18, 0x18, 0x00, 0x30, 0x08, 0x00, 0x20, 0x04, 0x06, 0x20,
-    0x04, 0x06, 0x43, 0x04, 0x80, 0x41, 0x02, 0x80, 0x40, 0x02, 0x80, 0x80,
-    0x02, 0x80, 0x80, 0x02, 0x80, 0x40, 0x04, 0x80, 0x41, 0x04, 0x06, 0x43,
-    0x04, 0x06, 0x20, 0x08, 0x00, 0x20, 0x18, 0x00, 0x30, 0x30, 0x00, 0x18,
-    0x60, 0x00, 0x0C, 0x80, 0x81, 0x03, 0x00, 0x7E, 0x00, 0x00, 0x00, 0x00};
+    0x00, 0x00, 0x80, 0x60, 0x30, 0x18, 0x08, 0x04, 0x04, 0x04, 0x02, 0x02,
+    0x02, 0x02, 0x04, 0x04, 0x04, 0x08, 0x18, 0x30, 0x60, 0x80, 0x00, 0x00,
+    0x00, 0x7E, 0x81, 0x00, 0x00, 0x00, 0x00, 0x06, 0x06, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x06, 0x06, 0x00, 0x00, 0x00, 0x00, 0x81, 0x7E, 0x00,
+    0x00, 0x00, 0x03, 0x0C, 0x18, 0x30, 0x20, 0x20, 0x43, 0x41, 0x40, 0x80,
+    0x80, 0x40, 0x41, 0x43, 0x20, 0x20, 0x30, 0x18, 0x0C, 0x03, 0x00, 0x00};
 
 const uint8_t font_battery_2_31[] = {
-    0x00, 0x00, 0xFE, 0x1F, 0xFF, 0x3F, 0x03, 0x30, 0xFB, 0x37, 0xFB,
-    0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37,
-    0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB,
-    0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37,
-    0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0xFB, 0x37, 0x03, 0x30, 0xFF,
-    0x3F, 0xFE, 0x1F, 0xF0, 0x03, 0xE0, 0x01};
+    0x00, 0xFE, 0xFF, 0x03, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB,
+    0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB, 0xFB,
+    0xFB, 0xFB, 0x03, 0xFF, 0xFE, 0xF0, 0xE0, 0x00, 0x1F, 0x3F, 0x30, 0x37,
+    0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37,
+    0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x37, 0x30, 0x3F, 0x1F,
+    0x03, 0x01};
 
 const uint8_t font_num_3_12[][36] = {
-    {0x00, 0x00, 0x00, 0x00, 0xFE, 0x01, 0x80, 0xFF, 0x07, 0xC0, 0x01, 0x0E,
-     0x60, 0x00, 0x18, 0x20, 0x00, 0x10, 0x20, 0x00, 0x10, 0x60, 0x00, 0x18,
-     0xC0, 0x01, 0x0E, 0x80, 0xFF, 0x07, 0x00, 0xFE, 0x01, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00, 0x10, 0x40, 0x00, 0x10,
-     0x40, 0x00, 0x10, 0xC0, 0xFF, 0x1F, 0xE0, 0xFF, 0x1F, 0x00, 0x00, 0x10,
-     0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x80, 0x03, 0x18, 0x40, 0x03, 0x1C, 0x20, 0x00, 0x12,
-     0x20, 0x00, 0x11, 0x20, 0xC0, 0x10, 0x20, 0x60, 0x10, 0x60, 0x30, 0x10,
-     0xC0, 0x1F, 0x10, 0x80, 0x07, 0x1E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0xC0, 0x01, 0x0E, 0xC0, 0x01, 0x0E, 0x20, 0x00, 0x10,
-     0x20, 0x10, 0x10, 0x20, 0x10, 0x10, 0x60, 0x18, 0x10, 0xC0, 0x2F, 0x18,
-     0x80, 0xE7, 0x0F, 0x00, 0x80, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0xA0, 0x00, 0x00, 0x98, 0x00,
-     0x00, 0x84, 0x00, 0x00, 0x83, 0x10, 0x80, 0x80, 0x10, 0xE0, 0xFF, 0x1F,
-     0xE0, 0xFF, 0x1F, 0x00, 0x80, 0x10, 0x00, 0x80, 0x10, 0x00, 0x80, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0xE0, 0x3F, 0x0B, 0x20, 0x10, 0x10,
-     0x20, 0x08, 0x10, 0x20, 0x08, 0x10, 0x20, 0x08, 0x10, 0x20, 0x18, 0x1C,
-     0x20, 0xF0, 0x0F, 0x20, 0xE0, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0xFC, 0x01, 0x80, 0xFF, 0x07, 0xC0, 0x21, 0x0C,
-     0x40, 0x10, 0x18, 0x20, 0x08, 0x10, 0x20, 0x08, 0x10, 0x20, 0x08, 0x10,
-     0xE0, 0x18, 0x08, 0xC0, 0xF0, 0x0F, 0x00, 0xE0, 0x03, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x01, 0x00, 0x60, 0x00, 0x00,
-     0x20, 0x00, 0x00, 0x20, 0x00, 0x1F, 0x20, 0xE0, 0x1F, 0x20, 0x18, 0x00,
-     0x20, 0x07, 0x00, 0xE0, 0x00, 0x00, 0x60, 0x00, 0x00, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x80, 0x83, 0x07, 0xC0, 0xCF, 0x0F, 0x60, 0x6C, 0x08,
-     0x20, 0x18, 0x10, 0x20, 0x10, 0x10, 0x20, 0x30, 0x10, 0x20, 0x30, 0x10,
-     0x60, 0x68, 0x18, 0xC0, 0xCF, 0x0F, 0x80, 0x83, 0x07, 0x00, 0x00, 0x00},
-
-    {0x00, 0x00, 0x00, 0x00, 0x1F, 0x00, 0xC0, 0x3F, 0x0C, 0xC0, 0x60, 0x1C,
-     0x20, 0x40, 0x10, 0x20, 0x40, 0x10, 0x20, 0x40, 0x10, 0x20, 0x20, 0x08,
-     0xC0, 0x10, 0x0F, 0x80, 0xFF, 0x03, 0x00, 0xFE, 0x00, 0x00, 0x00, 0x00}};
+    {0x00, 0x00, 0x80, 0xC0, 0x60, 0x20, 0x20, 0x60, 0xC0, 0x80, 0x00, 0x00,
+     0x00, 0xFE, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0xFF, 0xFE, 0x00,
+     0x00, 0x01, 0x07, 0x0E, 0x18, 0x10, 0x10, 0x18, 0x0E, 0x07, 0x01, 0x00},
+    {0x00, 0x00, 0x40, 0x40, 0x40, 0xC0, 0xE0, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x10, 0x10, 0x10, 0x1F, 0x1F, 0x10, 0x10, 0x10, 0x00, 0x00},
+    {0x00, 0x80, 0x40, 0x20, 0x20, 0x20, 0x20, 0x60, 0xC0, 0x80, 0x00, 0x00,
+     0x00, 0x03, 0x03, 0x00, 0x00, 0xC0, 0x60, 0x30, 0x1F, 0x07, 0x00, 0x00,
+     0x00, 0x18, 0x1C, 0x12, 0x11, 0x10, 0x10, 0x10, 0x10, 0x1E, 0x00, 0x00},
+    {0x00, 0xC0, 0xC0, 0x20, 0x20, 0x20, 0x60, 0xC0, 0x80, 0x00, 0x00, 0x00,
+     0x00, 0x01, 0x01, 0x00, 0x10, 0x10, 0x18, 0x2F, 0xE7, 0x80, 0x00, 0x00,
+     0x00, 0x0E, 0x0E, 0x10, 0x10, 0x10, 0x10, 0x18, 0x0F, 0x07, 0x00, 0x00},
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xE0, 0xE0, 0x00, 0x00, 0x00,
+     0x00, 0xC0, 0xA0, 0x98, 0x84, 0x83, 0x80, 0xFF, 0xFF, 0x80, 0x80, 0x80,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10, 0x1F, 0x1F, 0x10, 0x10, 0x00},
+    {0x00, 0x00, 0xE0, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x20, 0x00, 0x00,
+     0x00, 0x00, 0x3F, 0x10, 0x08, 0x08, 0x08, 0x18, 0xF0, 0xE0, 0x00, 0x00,
+     0x00, 0x07, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x1C, 0x0F, 0x03, 0x00, 0x00},
+    {0x00, 0x00, 0x80, 0xC0, 0x40, 0x20, 0x20, 0x20, 0xE0, 0xC0, 0x00, 0x00,
+     0x00, 0xFC, 0xFF, 0x21, 0x10, 0x08, 0x08, 0x08, 0x18, 0xF0, 0xE0, 0x00,
+     0x00, 0x01, 0x07, 0x0C, 0x18, 0x10, 0x10, 0x10, 0x08, 0x0F, 0x03, 0x00},
+    {0x00, 0x00, 0xC0, 0x60, 0x20, 0x20, 0x20, 0x20, 0x20, 0xE0, 0x60, 0x00,
+     0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xE0, 0x18, 0x07, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x00, 0x80, 0xC0, 0x60, 0x20, 0x20, 0x20, 0x20, 0x60, 0xC0, 0x80, 0x00,
+     0x00, 0x83, 0xCF, 0x6C, 0x18, 0x10, 0x30, 0x30, 0x68, 0xCF, 0x83, 0x00,
+     0x00, 0x07, 0x0F, 0x08, 0x10, 0x10, 0x10, 0x10, 0x18, 0x0F, 0x07, 0x00},
+    {0x00, 0x00, 0xC0, 0xC0, 0x20, 0x20, 0x20, 0x20, 0xC0, 0x80, 0x00, 0x00,
+     0x00, 0x1F, 0x3F, 0x60, 0x40, 0x40, 0x40, 0x20, 0x10, 0xFF, 0xFE, 0x00,
+     0x00, 0x00, 0x0C, 0x1C, 0x10, 0x10, 0x10, 0x08, 0x0F, 0x03, 0x00, 0x00}};
 
 const uint8_t font_num_2_8[][16] = {
-    {0x00, 0x00, 0xE0, 0x0F, 0x10, 0x10, 0x08, 0x20, 0x08, 0x20, 0x10, 0x10,
-     0xE0, 0x0F, 0x00, 0x00},
-    {0x00, 0x00, 0x00, 0x00, 0x10, 0x20, 0x10, 0x20, 0xF8, 0x3F, 0x00, 0x20,
-     0x00, 0x20, 0x00, 0x00},
-    {0x00, 0x00, 0x70, 0x30, 0x08, 0x28, 0x08, 0x24, 0x08, 0x22, 0x08, 0x21,
-     0xF0, 0x30, 0x00, 0x00},
-    {0x00, 0x00, 0x30, 0x18, 0x08, 0x20, 0x08, 0x21, 0x08, 0x21, 0x88, 0x22,
-     0x70, 0x1C, 0x00, 0x00},
-    {0x00, 0x00, 0x00, 0x06, 0x80, 0x05, 0x40, 0x24, 0x30, 0x24, 0xF8, 0x3F,
-     0x00, 0x24, 0x00, 0x24},
-    {0x00, 0x00, 0xF8, 0x19, 0x88, 0x20, 0x88, 0x20, 0x88, 0x20, 0x08, 0x11,
-     0x08, 0x0E, 0x00, 0x00},
-    {0x00, 0x00, 0xE0, 0x0F, 0x10, 0x11, 0x88, 0x20, 0x88, 0x20, 0x90, 0x20,
-     0x00, 0x1F, 0x00, 0x00},
-    {0x00, 0x00, 0x18, 0x00, 0x08, 0x00, 0x08, 0x3E, 0x88, 0x01, 0x68, 0x00,
-     0x18, 0x00, 0x00, 0x00},
-    {0x00, 0x00, 0x70, 0x1C, 0x88, 0x22, 0x08, 0x21, 0x08, 0x21, 0x88, 0x22,
-     0x70, 0x1C, 0x00, 0x00},
-    {0x00, 0x00, 0xF0, 0x01, 0x08, 0x12, 0x08, 0x22, 0x08, 0x22, 0x10, 0x11,
-     0xE0, 0x0F, 0x00, 0x00}};
-
-const uint8_t font_mao_2_8[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x30,
-                                0xC0, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    {0x00, 0xE0, 0x10, 0x08, 0x08, 0x10, 0xE0, 0x00, 0x00, 0x0F, 0x10, 0x20,
+     0x20, 0x10, 0x0F, 0x00},
+    {0x00, 0x00, 0x10, 0x10, 0xF8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x20,
+     0x3F, 0x20, 0x20, 0x00},
+    {0x00, 0x70, 0x08, 0x08, 0x08, 0x08, 0xF0, 0x00, 0x00, 0x30, 0x28, 0x24,
+     0x22, 0x21, 0x30, 0x00},
+    {0x00, 0x30, 0x08, 0x08, 0x08, 0x88, 0x70, 0x00, 0x00, 0x18, 0x20, 0x21,
+     0x21, 0x22, 0x1C, 0x00},
+    {0x00, 0x00, 0x80, 0x40, 0x30, 0xF8, 0x00, 0x00, 0x00, 0x06, 0x05, 0x24,
+     0x24, 0x3F, 0x24, 0x24},
+    {0x00, 0xF8, 0x88, 0x88, 0x88, 0x08, 0x08, 0x00, 0x00, 0x19, 0x20, 0x20,
+     0x20, 0x11, 0x0E, 0x00},
+    {0x00, 0xE0, 0x10, 0x88, 0x88, 0x90, 0x00, 0x00, 0x00, 0x0F, 0x11, 0x20,
+     0x20, 0x20, 0x1F, 0x00},
+    {0x00, 0x18, 0x08, 0x08, 0x88, 0x68, 0x18, 0x00, 0x00, 0x00, 0x00, 0x3E,
+     0x01, 0x00, 0x00, 0x00},
+    {0x00, 0x70, 0x88, 0x08, 0x08, 0x88, 0x70, 0x00, 0x00, 0x1C, 0x22, 0x21,
+     0x21, 0x22, 0x1C, 0x00},
+    {0x00, 0xF0, 0x08, 0x08, 0x08, 0x10, 0xE0, 0x00, 0x00, 0x01, 0x12, 0x22,
+     0x22, 0x11, 0x0F, 0x00}};
+
+const uint8_t font_mao_2_8[] = {
+    0x00, 0x00, 0x00, 0xC0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30,
+    0x30, 0x00, 0x00, 0x00};
 
 const uint8_t font_dot_3_12[] = {
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x1C,
-    0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x1C, 0x1C, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t font_plus_3_12[] = {
-    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00,
-    0x00, 0x10, 0x00, 0x00, 0x10, 0x00, 0x80, 0xFF, 0x03, 0x00, 0x10, 0x00,
-    0x00, 0x10, 0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00};
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0xFF, 0x10, 0x10, 0x10, 0x10, 0x10,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t font_wifi_2_16[] = {
-    0x00, 0x00, 0x40, 0x00, 0x20, 0x00, 0x90, 0x00, 0x90, 0x00, 0x48,
-    0x02, 0x48, 0x03, 0x48, 0x19, 0x48, 0x19, 0x48, 0x03, 0x48, 0x02,
-    0x90, 0x00, 0x90, 0x00, 0x20, 0x00, 0x40, 0x00, 0x00, 0x00};
+    0x00, 0x40, 0x20, 0x90, 0x90, 0x48, 0x48, 0x48, 0x48, 0x48, 0x48, 0x90,
+    0x90, 0x20, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x19,
+    0x19, 0x03, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/**
+ * @brief a set of glyphs of the same size, chars lists the character of
+ * each glyph in order
+ */
+typedef struct {
+    uint8_t row;  // height in pages
+    uint8_t col;  // width in columns
+    const char* chars;
+    const uint8_t* const* glyph;
+} font_t;
+
+const uint8_t* const glyph_2_8[] = {
+    font_num_2_8[0], font_num_2_8[1], font_num_2_8[2], font_num_2_8[3],
+    font_num_2_8[4], font_num_2_8[5], font_num_2_8[6], font_num_2_8[7],
+    font_num_2_8[8], font_num_2_8[9], font_mao_2_8,    font_B_2_8,
+    font_U_2_8,      font_A_2_8,      font_N_2_8,      font_D_2_8,
+    font_S_2_8,      font_T_2_8,      font_E_2_8,      font_M_2_8,
+    font_P_2_8};
+
+const uint8_t* const glyph_3_12[] = {
+    font_num_3_12[0], font_num_3_12[1], font_num_3_12[2], font_num_3_12[3],
+    font_num_3_12[4], font_num_3_12[5], font_num_3_12[6], font_num_3_12[7],
+    font_num_3_12[8], font_num_3_12[9], font_dot_3_12,    font_plus_3_12};
+
+const font_t font_2_8 = {2, 8, "0123456789:BUANDSTEMP", glyph_2_8};
+const font_t font_3_12 = {3, 12, "0123456789.+", glyph_3_12};
 
 #endif
\ No newline at end of file
@@ -1,124 +1,494 @@
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 
 #include "MAX30102.h"
 #include "MPU6050.h"
 #include "NAR_GPIO.h"
+#include "NAR_CONFIG.h"
 #include "NAR_I2C.h"
 #include "NAR_MQTT.h"
+#include "NAR_SCHED.h"
+#include "NAR_STREAM.h"
+#include "NAR_TELEMETRY.h"
 #include "SSD1306.h"
 
 #define STACK_SIZE 4096
+#define DOUBLE_PRESS_MS 600
+// how long a heart rate result stays on the screen
+#define HR_HOLD_MS 3000
+// hr job beyond the measurement: max_lock behind a stream that is stopping
+// (500 ms at most), the display and the telemetry record
+#define HR_SLACK_MS 1000
+#define MINUTE_US (60000000LL)
+#define HOUR_MS (3600000)
+// wear detection while nobody wears the band
+#define WEAR_POLL_MS 4500
+// defaults until a config command on ch_sub changes them, see NAR_CONFIG.h
+#define SENSOR_PERIOD_S 10
+#define FEVER 3730
+#define LONG_SIT_MIN 5
+// sample hr and wear sensor together, shorter but needs both on skin
+// #define DUAL_HR
+// log ssd1306 full frame latency of each transfer mode at boot
+// #define DISPLAY_BENCHMARK
+// print every displayed frame to the log as PBM, with bytes / crc
+// #define DISPLAY_DUMP
+// radio only on every RADIO_DUTY_MIN minutes or on an alert, to upload
+// #define RADIO_DUTY_MIN 10
 
 static const char* TAG = "BAND";
-static const char* ch_temp = "/band/temp";
-static const char* ch_hr = "/band/hr";
-static const char* ch_step = "/band/step";
-static const char* ch_pub = "/band/pub";
-static const char* ch_sub = "/band/sub";
-
-void thread_1(void* pvParameters) {
-    while (1) {
-        vTaskDelay(3000 / portTICK_PERIOD_MS);
-        if (NAR_GPIO_get_IO0_double_flag()) {
-            if (NAR_MQTT_get_connected()) {
-                NAR_MQTT_end();
-            } else {
-                NAR_MQTT_start();
-            }
-            NAR_GPIO_clear_IO0_double_flag();
-        }
+// band/<device id>/<leaf>, built by NAR_MQTT_topic() at init
+static const char* ch_batch = NULL;
+static const char* ch_last = NULL;
+static const char* ch_alert = NULL;
+static const char* ch_status = NULL;
+static const char* ch_stream = NULL;
+static const char* ch_pub = NULL;
+static const char* ch_sub = NULL;
+
+// NAR_SCHED jobs, see app_main
+static int wear_job = -1;
+static int sensor_job = -1;
+static int display_job = -1;
+static int button_job = -1;
+static int hr_job = -1;
+static int radio_job = -1;
+static int upload_job = -1;
+static int stream_job = -1;
+static int stats_job = -1;
+
+static volatile uint8_t active = 0;  // somebody wears the band
+static volatile uint8_t stream_wanted = 0;
+// MAX30102 calls are not reentrant, wear, temp and hr take turns
+static SemaphoreHandle_t max_lock = NULL;
+// latest sensor values, written by the sensor job
+static portMUX_TYPE values_lock = portMUX_INITIALIZER_UNLOCKED;
+static unsigned long step = 0;
+static double temp = 0;
+static uint8_t flags = 0;
+// only the display job renders, the hr job sets what it shows, under
+// values_lock. SSD1306_display_hr type, -1 - main menu
+static int8_t hr_type = -1;
+static uint8_t hr_value = 0;
+static int64_t hr_until = 0;  // a result shows until then, us
+
+static esp_timer_handle_t minute_timer = NULL;
+static esp_timer_handle_t press_timer = NULL;
+static esp_timer_handle_t hold_timer = NULL;
+
+static void minute_cb(void* arg) {
+    NAR_SCHED_trigger(display_job);
+    // re-arm on the next boundary so the header clock never lags
+    esp_timer_start_once(minute_timer,
+                         MINUTE_US - esp_timer_get_time() % MINUTE_US);
+}
+
+/**
+ * @brief raw ppg and accelerometer to ch_stream, for algorithm work. The
+ * stream job applies it, safe from any task
+ */
+static void set_streaming(uint8_t on_off) {
+    stream_wanted = on_off;
+    NAR_SCHED_trigger(stream_job);
+}
+
+static void mqtt_cb(NAR_MQTT_state_t state) {
+    if (state != NAR_MQTT_CONNECTED) {
+        // nobody would receive it
+        set_streaming(0);
     }
+    NAR_SCHED_trigger(upload_job);
 }
 
-static inline void heart_rate_task() {
-    NAR_GPIO_clear_IO0_flag();
-    SSD1306_display_hr(0, 0, NAR_MQTT_get_connected());
-    uint8_t hr = MAX30102_get_hr();
-    if (hr) {
-        SSD1306_display_hr(1, hr, NAR_MQTT_get_connected());
-        if (NAR_MQTT_get_connected()) {
-            char msg[10];
-            sprintf(msg, "%u", hr);
-            NAR_MQTT_pub(ch_hr, msg);
+/**
+ * @brief e.g. "period=30 fever=37.5 hr=dual", the answer goes to ch_pub
+ */
+static void command_cb(const char* data, int len) {
+    char reply[48];
+    NAR_CONFIG_apply(data, len, reply, sizeof(reply));
+    NAR_MQTT_pub(NAR_MQTT_REPLY, ch_pub, reply);
+}
+
+/**
+ * @brief radio, streaming and job periods follow at once, the jobs pick up
+ * the rest from their next NAR_CONFIG_get()
+ */
+static void config_cb() {
+    NAR_CONFIG_t config;
+    NAR_CONFIG_get(&config);
+    NAR_TELEMETRY_set_duty_cycle(config.duty_min);
+    set_streaming(config.stream);
+    NAR_SCHED_set_period(sensor_job, config.period_s * 1000);
+    if (active) {
+        NAR_SCHED_set_period(wear_job, config.period_s * 1000);
+    }
+    NAR_SCHED_trigger(display_job);
+}
+
+static void tap_cb() {
+    SSD1306_wake();
+}
+
+static void raise_cb(int64_t time) {
+    SSD1306_wake_at(time);
+}
+
+static void button_cb() {
+    NAR_SCHED_trigger_from_isr(button_job);
+}
+
+/**
+ * @brief DOUBLE_PRESS_MS after a press, the flag is still set unless a
+ * second press made it a double press
+ */
+static void press_cb(void* arg) {
+    if (NAR_GPIO_get_IO0_flag()) {
+        NAR_SCHED_trigger(hr_job);
+    }
+}
+
+/**
+ * @brief a heart rate result timed out, back to the main menu
+ */
+static void hold_cb(void* arg) {
+    NAR_SCHED_trigger(display_job);
+}
+
+/**
+ * @brief a double press toggles the radio
+ */
+static void radio_run() {
+    if (NAR_GPIO_get_IO0_double_flag()) {
+        NAR_CONFIG_t config;
+        NAR_CONFIG_get(&config);
+        if (config.duty_min) {
+            // the duty cycle owns the radio, just upload now
+            NAR_TELEMETRY_sync();
+        } else if (NAR_MQTT_get_state() != NAR_MQTT_OFF) {
+            // still connecting counts as on, a double press cancels it
+            NAR_MQTT_end();
+        } else {
+            NAR_MQTT_start();
         }
-    } else {
-        SSD1306_display_hr(2, 0, NAR_MQTT_get_connected());
+        NAR_GPIO_clear_IO0_double_flag();
     }
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
+}
+
+/**
+ * @brief what the display job shows next
+ * @param[in] type SSD1306_display_hr type, -1 - main menu
+ */
+static void show_hr(int8_t type, uint8_t hr) {
+    portENTER_CRITICAL(&values_lock);
+    hr_type = type;
+    hr_value = hr;
+    hr_until = esp_timer_get_time() + HR_HOLD_MS * 1000LL;
+    portEXIT_CRITICAL(&values_lock);
+    NAR_SCHED_trigger(display_job);
+}
+
+static inline uint8_t heart_rate_task(uint8_t dual) {
+    NAR_GPIO_clear_IO0_flag();
+    esp_timer_stop(hold_timer);
+    show_hr(0, 0);
+    xSemaphoreTake(max_lock, portMAX_DELAY);
+    uint8_t hr = dual ? MAX30102_get_hr_dual() : MAX30102_get_hr();
+    xSemaphoreGive(max_lock);
+    show_hr(hr ? 1 : 2, hr);
+    // the display job goes back to the main menu once the result timed out
+    esp_timer_start_once(hold_timer, HR_HOLD_MS * 1000LL);
+    // the result should be readable even if the screen dimmed meanwhile
+    SSD1306_wake();
+    return hr;
 }
 
 static inline void band_init() {
     NAR_GPIO_init();
     i2c_init();
+#ifdef DISPLAY_BENCHMARK
+    SSD1306_benchmark();
+#endif
     SSD1306_init();
+#ifdef DISPLAY_DUMP
+    SSD1306_set_dump(1);
+#endif
     MAX30102_init();
     MPU6050_init();
     NAR_MQTT_init();
-    TaskHandle_t xHandle = NULL;
-    xTaskCreate(thread_1, "thread_1", STACK_SIZE, NULL, tskIDLE_PRIORITY,
-                &xHandle);
-    configASSERT(xHandle);
+    ch_batch = NAR_MQTT_topic("batch");
+    ch_last = NAR_MQTT_topic("last");
+    ch_alert = NAR_MQTT_topic("alert");
+    ch_status = NAR_MQTT_topic("status");
+    ch_stream = NAR_MQTT_topic("stream");
+    ch_pub = NAR_MQTT_topic("pub");
+    ch_sub = NAR_MQTT_topic("sub");
+    ESP_LOGI(TAG, "device %s", NAR_MQTT_get_device_id());
+    NAR_CONFIG_t defaults = {
+        .period_s = SENSOR_PERIOD_S,
+        .fever = FEVER,
+        .sit_min = LONG_SIT_MIN,
+    };
+#ifdef DUAL_HR
+    defaults.dual_hr = 1;
+#endif
+#ifdef RADIO_DUTY_MIN
+    defaults.duty_min = RADIO_DUTY_MIN;
+#endif
+    NAR_CONFIG_init(&defaults);
+    NAR_CONFIG_t config;
+    NAR_CONFIG_get(&config);
+    NAR_MQTT_set_status_topic(ch_status);
+    NAR_TELEMETRY_init(ch_batch, ch_last);
+    NAR_TELEMETRY_set_duty_cycle(config.duty_min);
+    max_lock = xSemaphoreCreateMutex();
+    configASSERT(max_lock);
+    esp_timer_create_args_t minute_args = {
+        .callback = minute_cb,
+        .name = "minute",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&minute_args, &minute_timer));
+    ESP_ERROR_CHECK(esp_timer_start_once(
+        minute_timer, MINUTE_US - esp_timer_get_time() % MINUTE_US));
+    esp_timer_create_args_t press_args = {
+        .callback = press_cb,
+        .name = "press",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&press_args, &press_timer));
+    esp_timer_create_args_t hold_args = {
+        .callback = hold_cb,
+        .name = "hold",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&hold_args, &hold_timer));
+    NAR_GPIO_set_IO0_callback(button_cb);
+    NAR_MQTT_set_state_callback(mqtt_cb);
+    NAR_MQTT_set_command_callback(ch_sub, command_cb);
+    NAR_CONFIG_set_callback(config_cb);
+    MPU6050_set_tap_callback(tap_cb);
+    MPU6050_set_raise_callback(raise_cb);
+}
+
+/**
+ * @brief wear detection, switches the band between active and sleep
+ */
+static void wear_run() {
+    if (xSemaphoreTake(max_lock, 0) != pdTRUE) {
+        // a heart rate capture, so somebody wears it
+        return;
+    }
+    uint8_t on = MAX30102_on();
+    xSemaphoreGive(max_lock);
+    if (on == active) {
+        return;
+    }
+    active = on;
+    if (on) {
+        ESP_LOGI(TAG, "active");
+        NAR_GPIO_set_LED(1);
+        SSD1306_set_display(1);
+        NAR_GPIO_clear_IO0_flag();
+        NAR_CONFIG_t config;
+        NAR_CONFIG_get(&config);
+        // while worn, checking with each sensor pass is enough
+        NAR_SCHED_set_period(wear_job, config.period_s * 1000);
+        NAR_SCHED_resume(sensor_job);
+        NAR_SCHED_resume(display_job);
+    } else {
+        ESP_LOGI(TAG, "sleep");
+        NAR_SCHED_suspend(sensor_job);
+        NAR_SCHED_suspend(display_job);
+        NAR_SCHED_set_period(wear_job, WEAR_POLL_MS);
+        NAR_GPIO_set_LED(0);
+        NAR_GPIO_set_BUZ(0);
+        SSD1306_set_display(0);
+        set_streaming(0);
+        NAR_TELEMETRY_flush();
+    }
+}
+
+// sensor job only
+static uint32_t long_sit_s = 0;
+static unsigned long last_step = 0;
+static uint16_t shown_temp = 0;
+
+/**
+ * @brief temperature, steps and alarms, every config.period_s
+ */
+static void sensor_run() {
+    NAR_CONFIG_t config;
+    NAR_CONFIG_get(&config);
+    double new_temp = temp;
+    // during a heart rate capture the last reading stands
+    if (xSemaphoreTake(max_lock, 0) == pdTRUE) {
+        new_temp = MAX30102_get_temp();
+        xSemaphoreGive(max_lock);
+    }
+    unsigned long new_step = MPU6050_get_step();
+    uint8_t redraw = 0;
+    if (new_step != 999999 && new_step == last_step) {
+        long_sit_s += config.period_s;
+    } else {
+        long_sit_s = 0;
+        last_step = new_step;
+        redraw = 1;
+    }
+    uint8_t fever = new_temp * 100 > config.fever;
+    uint8_t sat = config.sit_min && long_sit_s >= config.sit_min * 60;
+    uint8_t alarm =
+        (fever ? NAR_PAYLOAD_FEVER : 0) | (sat ? NAR_PAYLOAD_LONG_SIT : 0);
+    NAR_GPIO_set_BUZ(alarm != 0);
+    NAR_TELEMETRY_add(new_temp, new_step, 0, alarm);
+    portENTER_CRITICAL(&values_lock);
+    uint8_t raised = alarm & ~flags;
+    temp = new_temp;
+    step = new_step;
+    flags = alarm;
+    portEXIT_CRITICAL(&values_lock);
+    if (raised) {
+        NAR_TELEMETRY_flush();
+        NAR_TELEMETRY_sync();
+    }
+    if (raised & NAR_PAYLOAD_FEVER) {
+        NAR_MQTT_pub(NAR_MQTT_ALERT, ch_alert, "fever");
+    }
+    if (raised & NAR_PAYLOAD_LONG_SIT) {
+        NAR_MQTT_pub(NAR_MQTT_ALERT, ch_alert, "long_sit");
+    }
+    // the screen shows 0.1 degree
+    if ((uint16_t)(new_temp * 10 + 0.5) != shown_temp) {
+        shown_temp = new_temp * 10 + 0.5;
+        redraw = 1;
+    }
+    if (redraw) {
+        NAR_SCHED_trigger(display_job);
+    }
+}
+
+/**
+ * @brief the only job that renders. The heart rate screen while a capture
+ * runs or its result holds, else the main menu. On new values, the minute,
+ * a radio change or a heart rate state change
+ */
+static void display_run() {
+    portENTER_CRITICAL(&values_lock);
+    unsigned long s = step;
+    double t = temp;
+    if (hr_type > 0 && esp_timer_get_time() >= hr_until) {
+        hr_type = -1;
+    }
+    int8_t type = hr_type;
+    uint8_t hr = hr_value;
+    portEXIT_CRITICAL(&values_lock);
+    if (type >= 0) {
+        SSD1306_display_hr(type, hr, NAR_MQTT_get_connected());
+    } else {
+        SSD1306_display_main_menu(s, t, NAR_MQTT_get_connected());
+    }
+}
+
+/**
+ * @brief a single press measures heart rate, a double press is left to the
+ * radio job. press_timer tells them apart, a second press while it runs
+ * finds it started already
+ */
+static void button_run() {
+    if (!active) {
+        return;
+    }
+    SSD1306_wake();
+    esp_timer_start_once(press_timer, DOUBLE_PRESS_MS * 1000LL);
+}
+
+static void hr_run() {
+    NAR_CONFIG_t config;
+    NAR_CONFIG_get(&config);
+    uint8_t hr = heart_rate_task(config.dual_hr);
+    if (hr) {
+        portENTER_CRITICAL(&values_lock);
+        unsigned long s = step;
+        double t = temp;
+        uint8_t f = flags;
+        portEXIT_CRITICAL(&values_lock);
+        // someone is waiting for this one on the phone
+        NAR_TELEMETRY_add(t, s, hr, f);
+        NAR_TELEMETRY_flush();
+        NAR_TELEMETRY_sync();
+    }
+}
+
+/**
+ * @brief start or stop streaming under max_lock, so a stream never starts
+ * in the middle of a heart rate capture, it waits for the capture instead
+ */
+static void stream_run() {
+    uint8_t on = stream_wanted;
+    xSemaphoreTake(max_lock, portMAX_DELAY);
+    if (on) {
+        MAX30102_stream(1);
+        NAR_STREAM_start(ch_stream);
+    } else {
+        NAR_STREAM_stop();
+        MAX30102_stream(0);
+    }
+    xSemaphoreGive(max_lock);
+}
+
+/**
+ * @brief whatever queued up while offline
+ */
+static void upload_run() {
+    NAR_TELEMETRY_flush();
+    NAR_SCHED_trigger(display_job);
+}
+
+static void stats_run() {
+    NAR_SCHED_log();
+}
+
+static int add_job(const char* name,
+                   void (*run)(),
+                   uint32_t period_ms,
+                   uint32_t deadline_ms,
+                   UBaseType_t priority) {
+    NAR_SCHED_job_t job = {
+        .name = name,
+        .run = run,
+        .period_ms = period_ms,
+        .deadline_ms = deadline_ms,
+        .priority = priority,
+        .stack_size = STACK_SIZE,
+    };
+    int id = NAR_SCHED_add(&job);
+    configASSERT(id >= 0);
+    return id;
 }
 
 void app_main(void) {
     ESP_LOGI(TAG, "band start");
     band_init();
 
-    // sleep mode loop
-    while (1) {
-        if (MAX30102_on()) {
-            ESP_LOGI(TAG, "active");
-            NAR_GPIO_set_LED(1);
-            SSD1306_set_display(1);
-            NAR_GPIO_clear_IO0_flag();
-            break;
-        }
-    sleep:
-        vTaskDelay(4500 / portTICK_PERIOD_MS);
-    }
-
-    // active mode loop
-    uint8_t long_sit_count = 0;
-    unsigned long last_step = 0;
-    while (1) {
-        double temp = MAX30102_get_temp();
-        unsigned long step = MPU6050_get_step();
-        if (step != 999999 && step == last_step) {
-            long_sit_count++;
-        } else {
-            long_sit_count = 0;
-            last_step = step;
-        }
-        if (temp > 37.3 || long_sit_count >= 30) {
-            NAR_GPIO_set_BUZ(1);
-        } else {
-            NAR_GPIO_set_BUZ(0);
-        }
-        SSD1306_display_main_menu(step, temp, NAR_MQTT_get_connected());
-        if (NAR_MQTT_get_connected()) {
-            char msg[10];
-            sprintf(msg, "%.2lf", temp);
-            NAR_MQTT_pub(ch_temp, msg);
-            sprintf(msg, "%lu", step);
-            NAR_MQTT_pub(ch_step, msg);
-        }
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        if (NAR_GPIO_get_IO0_flag()) {
-            heart_rate_task();
-        }
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        if (!MAX30102_on()) {
-            ESP_LOGI(TAG, "sleep");
-            NAR_GPIO_set_LED(0);
-            NAR_GPIO_set_BUZ(0);
-            SSD1306_set_display(0);
-            // disconnect
-            goto sleep;
-        }
-        if (NAR_GPIO_get_IO0_flag()) {
-            heart_rate_task();
-        }
-    }
-}
+    // what the wearer sees first, the long heart rate capture last
+    NAR_CONFIG_t config;
+    NAR_CONFIG_get(&config);
+    display_job = add_job("display", display_run, 0, 200, 5);
+    button_job = add_job("button", button_run, 0, 1000, 5);
+    sensor_job = add_job("sensor", sensor_run, config.period_s * 1000, 1000, 4);
+    wear_job = add_job("wear", wear_run, WEAR_POLL_MS, 1000, 3);
+    upload_job = add_job("upload", upload_run, 0, 5000, 3);
+    radio_job = add_job("radio", radio_run, 3000, 1000, 2);
+    // may wait for a whole heart rate capture, no deadline
+    stream_job = add_job("stream", stream_run, 0, 0, 2);
+    hr_job = add_job("hr", hr_run, 0, MAX30102_get_hr_max_ms() + HR_SLACK_MS,
+                     1);
+    stats_job = add_job("stats", stats_run, HOUR_MS, 0, 1);
+    // sensor and display follow the wear job
+    NAR_SCHED_resume(wear_job);
+    NAR_SCHED_resume(button_job);
+    NAR_SCHED_resume(upload_job);
+    NAR_SCHED_resume(radio_job);
+    NAR_SCHED_resume(stream_job);
+    NAR_SCHED_resume(hr_job);
+    NAR_SCHED_resume(stats_job);
+}
\ No newline at end of file
@@ -0,0 +1,554 @@
+/**
+ * @file fleet_sim.c
+ * @brief host load generator, many simulated bands publish telemetry to a
+ * local broker with the firmware's own payload code
+ * @author Narukara
+ * @date 2021.2
+ *
+ * mosquitto -p 1883 &
+ * ./fleet_sim -n 1,10,100,1000,10000 -s 60 -x 60
+ *
+ * For each fleet size the bands connect, publish for -s seconds and a line
+ * is printed: broker message rate (seen by a subscriber on band/#), bytes
+ * per band per simulated hour and PUBACK latency percentiles. -x runs the
+ * band clock faster than the wall clock, so an hour of records fits in a
+ * minute. Large fleets need one socket per band, raise ulimit -n first.
+ *
+ * Topics follow the firmware, band/<device id>/<leaf>, with made up device
+ * ids. -g reads through $share/<group>/band/+/+ instead, to try the broker's
+ * shared subscriptions. Like the firmware, a band logs in with its client
+ * id band-<device id> as the username and the -P password, -u is only the
+ * monitor's.
+ */
+#include <getopt.h>
+#include <mosquitto.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NAR_PAYLOAD.h"
+
+// NAR_MQTT_TOPIC_ROOT, NAR_MQTT.h needs ESP-IDF
+#define TOPIC_ROOT "band"
+#define MAX_BATCH (100)
+// QoS 1 publishes per band waiting for PUBACK
+#define PENDING_LENGTH (64)
+#define KEEPALIVE_S (60)
+#define CONNECT_TIMEOUT_US (30000000LL)
+
+typedef enum { FORMAT_BATCH, FORMAT_TEXT } format_t;
+
+typedef struct {
+    char id[13];  // 12 hex digits like the eFuse MAC
+    struct mosquitto* mosq;
+    uint8_t connected;
+    int64_t next_record;  // us, wall clock
+    uint16_t boot;        // like the NVS boot counter
+    uint32_t time;        // s since boot, band clock
+    int16_t temp;
+    uint32_t step;
+    NAR_PAYLOAD_record_t records[MAX_BATCH];
+    uint8_t count;
+    struct {
+        int mid;  // 0 - free
+        int64_t time;
+    } pending[PENDING_LENGTH];
+} band_t;
+
+static struct {
+    const char* host;
+    int port;
+    const char* cafile;
+    const char* username;
+    const char* password;
+    const char* group;  // shared subscription of the monitor, Nullable
+    uint32_t period_s;  // one record per period, band clock
+    uint8_t batch;      // records per publish
+    format_t format;
+    int qos;
+    uint32_t seconds;  // wall clock per fleet size
+    uint32_t speed;    // band clock / wall clock
+} opt = {
+    .host = "localhost",
+    .port = 1883,
+    .period_s = 10,
+    .batch = 30,
+    .format = FORMAT_BATCH,
+    .qos = 1,
+    .seconds = 60,
+    .speed = 1,
+};
+
+// counters of the running fleet size
+static struct {
+    uint64_t records;
+    uint64_t published;
+    uint64_t packet_bytes;  // PUBLISH and PUBACK on the wire
+    uint64_t payload_bytes;
+    uint64_t lost;  // pending slot reused before its PUBACK
+    uint64_t received;  // by the monitor
+    uint64_t received_bytes;
+    uint64_t bad;  // payloads the monitor could not decode
+    uint32_t* latency;  // us
+    size_t latency_count;
+    size_t latency_size;
+} run;
+
+// topic leaves of the firmware, NAR_MQTT_topic()
+static const char* ch_batch = "batch";
+static const char* ch_temp = "temp";
+static const char* ch_step = "step";
+static const char* ch_hr = "hr";
+
+static band_t* bands = NULL;
+static int band_count = 0;
+static struct mosquitto* monitor = NULL;
+static uint8_t monitor_ready = 0;
+
+static int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void die(const char* what, int rc) {
+    fprintf(stderr, "%s: %s\n", what, mosquitto_strerror(rc));
+    exit(1);
+}
+
+/**
+ * @return bytes of a PUBLISH packet, fixed header, topic, packet id, payload
+ */
+static uint32_t packet_size(const char* topic, size_t len) {
+    uint32_t remaining = 2 + strlen(topic) + (opt.qos ? 2 : 0) + len;
+    uint32_t header = 2;
+    for (uint32_t r = remaining; r > 127; r >>= 7) {
+        header++;
+    }
+    return header + remaining;
+}
+
+static void add_latency(uint32_t us) {
+    if (run.latency_count == run.latency_size) {
+        run.latency_size = run.latency_size ? run.latency_size * 2 : 4096;
+        run.latency =
+            realloc(run.latency, run.latency_size * sizeof(uint32_t));
+        if (run.latency == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    run.latency[run.latency_count++] = us;
+}
+
+static void connect_cb(struct mosquitto* mosq, void* obj, int rc) {
+    if (rc) {
+        fprintf(stderr, "connect refused: %s\n", mosquitto_connack_string(rc));
+        return;
+    }
+    if (mosq == monitor) {
+        char sub[64] = TOPIC_ROOT "/#";
+        if (opt.group) {
+            snprintf(sub, sizeof(sub), "$share/%s/" TOPIC_ROOT "/+/+",
+                     opt.group);
+        }
+        mosquitto_subscribe(mosq, NULL, sub, 0);
+    } else {
+        ((band_t*)obj)->connected = 1;
+    }
+}
+
+static void subscribe_cb(struct mosquitto* mosq,
+                         void* obj,
+                         int mid,
+                         int count,
+                         const int* granted) {
+    monitor_ready = 1;
+}
+
+/**
+ * @brief QoS 1 PUBACK, QoS 0 publishes are not followed
+ */
+static void publish_cb(struct mosquitto* mosq, void* obj, int mid) {
+    band_t* band = obj;
+    for (int i = 0; i < PENDING_LENGTH; i++) {
+        if (band->pending[i].mid == mid) {
+            band->pending[i].mid = 0;
+            add_latency(now_us() - band->pending[i].time);
+            run.packet_bytes += 4;
+            return;
+        }
+    }
+}
+
+static void message_cb(struct mosquitto* mosq,
+                       void* obj,
+                       const struct mosquitto_message* msg) {
+    run.received++;
+    run.received_bytes += msg->payloadlen;
+    const char* leaf = strrchr(msg->topic, '/');
+    if (opt.format == FORMAT_BATCH && leaf && strcmp(leaf + 1, ch_batch) == 0) {
+        NAR_PAYLOAD_record_t records[MAX_BATCH];
+        if (NAR_PAYLOAD_decode(msg->payload, msg->payloadlen, records,
+                               MAX_BATCH) == 0) {
+            run.bad++;
+        }
+    }
+}
+
+/**
+ * @param[in] username NULL - no login
+ */
+static struct mosquitto* new_client(const char* id, const char* username) {
+    struct mosquitto* mosq = mosquitto_new(id, 1, NULL);
+    if (mosq == NULL) {
+        fprintf(stderr, "mosquitto_new failed\n");
+        exit(1);
+    }
+    int rc;
+    if (opt.cafile &&
+        (rc = mosquitto_tls_set(mosq, opt.cafile, NULL, NULL, NULL, NULL))) {
+        die("tls", rc);
+    }
+    if (username &&
+        (rc = mosquitto_username_pw_set(mosq, username, opt.password))) {
+        die("username", rc);
+    }
+    mosquitto_connect_callback_set(mosq, connect_cb);
+    if ((rc = mosquitto_connect(mosq, opt.host, opt.port, KEEPALIVE_S))) {
+        die("connect", rc);
+    }
+    return mosq;
+}
+
+static void publish(band_t* band,
+                    const char* leaf,
+                    const void* data,
+                    size_t len) {
+    char topic[64];
+    snprintf(topic, sizeof(topic), TOPIC_ROOT "/%s/%s", band->id,
+             leaf);
+    int mid = 0;
+    int64_t now = now_us();
+    int rc = mosquitto_publish(band->mosq, &mid, topic, len, data, opt.qos, 0);
+    if (rc) {
+        die("publish", rc);
+    }
+    run.published++;
+    run.payload_bytes += len;
+    run.packet_bytes += packet_size(topic, len);
+    if (opt.qos == 0) {
+        return;
+    }
+    int slot = 0;
+    for (int i = 0; i < PENDING_LENGTH; i++) {
+        if (band->pending[i].mid == 0) {
+            slot = i;
+            break;
+        }
+        if (band->pending[i].time < band->pending[slot].time) {
+            slot = i;
+        }
+    }
+    if (band->pending[slot].mid) {
+        run.lost++;
+    }
+    band->pending[slot].mid = mid;
+    band->pending[slot].time = now;
+}
+
+/**
+ * @brief one record per period, the same flush rule as NAR_TELEMETRY: a
+ * batch goes out when full, text sends each value as it is measured
+ */
+static void band_record(band_t* band) {
+    NAR_PAYLOAD_record_t* r = &band->records[band->count++];
+    band->time += opt.period_s;
+    band->temp += rand() % 5 - 2;
+    if (band->temp < 3550 || band->temp > 3750) {
+        band->temp = 3650;
+    }
+    band->step += rand() % 20;
+    r->boot = band->boot;
+    r->time = band->time;
+    r->temp = band->temp;
+    r->step = band->step;
+    // heart rate is measured once a minute
+    r->hr = band->time % 60 < opt.period_s ? 60 + rand() % 40 : 0;
+    r->flags = 0;
+    run.records++;
+    if (opt.format == FORMAT_TEXT) {
+        char msg[16];
+        publish(band, ch_temp, msg,
+                snprintf(msg, sizeof(msg), "%.2lf", r->temp / 100.0));
+        publish(band, ch_step, msg,
+                snprintf(msg, sizeof(msg), "%u", r->step));
+        if (r->hr) {
+            publish(band, ch_hr, msg,
+                    snprintf(msg, sizeof(msg), "%u", r->hr));
+        }
+        band->count = 0;
+    } else if (band->count == opt.batch) {
+        uint8_t buf[NAR_PAYLOAD_SIZE(MAX_BATCH)];
+        size_t len = NAR_PAYLOAD_encode(band->records, band->count, buf,
+                                        sizeof(buf));
+        publish(band, ch_batch, buf, len);
+        band->count = 0;
+    }
+}
+
+static void service(struct mosquitto* mosq, short revents, uint8_t misc) {
+    if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        mosquitto_loop_read(mosq, 1);
+    }
+    if (revents & POLLOUT) {
+        mosquitto_loop_write(mosq, 1);
+    }
+    if (misc) {
+        mosquitto_loop_misc(mosq);
+    }
+}
+
+/**
+ * @brief single thread, every socket in one poll()
+ * @param[in] until wall clock, us
+ * @param[in] generate 0 - only move packets, 1 - bands make records too
+ * @param[in] done Nullable, returns early once it is true
+ */
+static void loop(int64_t until, uint8_t generate, uint8_t (*done)()) {
+    struct pollfd* fds = calloc(band_count + 1, sizeof(struct pollfd));
+    int64_t step_us = opt.period_s * 1000000LL / opt.speed;
+    int64_t last_misc = 0;
+    for (int64_t now = now_us(); now < until; now = now_us()) {
+        if (done && done()) {
+            break;
+        }
+        for (int i = 0; generate && i < band_count; i++) {
+            while (bands[i].connected && bands[i].next_record <= now) {
+                band_record(&bands[i]);
+                bands[i].next_record += step_us;
+            }
+        }
+        for (int i = 0; i <= band_count; i++) {
+            struct mosquitto* mosq = i < band_count ? bands[i].mosq : monitor;
+            fds[i].fd = mosquitto_socket(mosq);
+            fds[i].events = POLLIN;
+            if (mosquitto_want_write(mosq)) {
+                fds[i].events |= POLLOUT;
+            }
+            fds[i].revents = 0;
+        }
+        poll(fds, band_count + 1, 10);
+        uint8_t misc = now - last_misc > 1000000;
+        if (misc) {
+            last_misc = now;
+        }
+        for (int i = 0; i <= band_count; i++) {
+            service(i < band_count ? bands[i].mosq : monitor, fds[i].revents,
+                    misc);
+        }
+    }
+    free(fds);
+}
+
+static uint8_t all_connected() {
+    if (!monitor_ready) {
+        return 0;
+    }
+    for (int i = 0; i < band_count; i++) {
+        if (!bands[i].connected) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(uint32_t per_mille) {
+    if (run.latency_count == 0) {
+        return 0;
+    }
+    size_t rank = (run.latency_count * per_mille + 999) / 1000;
+    return run.latency[rank ? rank - 1 : 0] / 1000.0;
+}
+
+/**
+ * @brief grow the fleet to count bands, publish for opt.seconds, report
+ */
+static void run_fleet(int count) {
+    bands = realloc(bands, count * sizeof(band_t));
+    if (bands == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (int i = band_count; i < count; i++) {
+        char id[32];
+        memset(&bands[i], 0, sizeof(band_t));
+        // locally administered MAC range, pid keeps parallel runs apart
+        snprintf(bands[i].id, sizeof(bands[i].id), "02%04x%06x",
+                 getpid() & 0xffff, i);
+        snprintf(id, sizeof(id), "band-%s", bands[i].id);
+        bands[i].boot = 1;
+        bands[i].temp = 3650;
+        // the objects moved with realloc, so point every client at its band
+        bands[i].mosq = new_client(id, id);
+        mosquitto_publish_callback_set(bands[i].mosq, publish_cb);
+    }
+    for (int i = 0; i < count; i++) {
+        mosquitto_user_data_set(bands[i].mosq, &bands[i]);
+    }
+    band_count = count;
+    loop(now_us() + CONNECT_TIMEOUT_US, 0, all_connected);
+    if (!all_connected()) {
+        fprintf(stderr, "%d bands: not all connected in time\n", count);
+        exit(1);
+    }
+
+    free(run.latency);
+    memset(&run, 0, sizeof(run));
+    int64_t start = now_us();
+    int64_t step_us = opt.period_s * 1000000LL / opt.speed;
+    for (int i = 0; i < band_count; i++) {
+        // spread over one period, a fleet does not boot in lockstep
+        bands[i].next_record = start + rand() % (step_us ? step_us : 1);
+    }
+    loop(start + opt.seconds * 1000000LL, 1, NULL);
+    // let the last PUBACKs arrive
+    loop(now_us() + 1000000, 0, NULL);
+    double seconds = (now_us() - start) / 1e6;
+
+    qsort(run.latency, run.latency_count, sizeof(uint32_t), compare_u32);
+    double band_hours = (double)run.records * opt.period_s / 3600;
+    if (band_hours == 0) {
+        band_hours = 1;
+    }
+    printf("%6d bands %9.1f msg/s %10.0f B/s, %8.0f B/band/h (%8.0f payload) "
+           "PUBACK p50 %7.2f p90 %7.2f p99 %7.2f max %8.2f ms, "
+           "%llu lost, %llu bad\n",
+           count, run.received / seconds, run.received_bytes / seconds,
+           run.packet_bytes / band_hours,
+           run.payload_bytes / band_hours, percentile_ms(500),
+           percentile_ms(900), percentile_ms(990),
+           run.latency_count
+               ? run.latency[run.latency_count - 1] / 1000.0
+               : 0,
+           (unsigned long long)run.lost, (unsigned long long)run.bad);
+    fflush(stdout);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -h host      broker, localhost\n"
+            "  -p port      1883\n"
+            "  -c cafile    use TLS\n"
+            "  -u user      monitor login, bands use their client id\n"
+            "  -P password  for all logins\n"
+            "  -g group     monitor through a shared subscription\n"
+            "  -n sizes     fleet sizes, 1,10,100,1000,10000\n"
+            "  -s seconds   wall clock per fleet size, 60\n"
+            "  -x speed     band clock / wall clock, 1\n"
+            "  -t period    s between records, 10\n"
+            "  -b records   per batch publish, 1..%d, 30\n"
+            "  -f format    batch | text, batch\n"
+            "  -q qos       0 | 1, 1\n",
+            name, MAX_BATCH);
+    exit(2);
+}
+
+int main(int argc, char* argv[]) {
+    char default_sizes[] = "1,10,100,1000,10000";
+    char* sizes = default_sizes;
+    int c;
+    while ((c = getopt(argc, argv, "h:p:c:u:P:g:n:s:x:t:b:f:q:")) != -1) {
+        switch (c) {
+            case 'h':
+                opt.host = optarg;
+                break;
+            case 'p':
+                opt.port = atoi(optarg);
+                break;
+            case 'c':
+                opt.cafile = optarg;
+                break;
+            case 'u':
+                opt.username = optarg;
+                break;
+            case 'P':
+                opt.password = optarg;
+                break;
+            case 'g':
+                opt.group = optarg;
+                break;
+            case 'n':
+                sizes = optarg;
+                break;
+            case 's':
+                opt.seconds = atoi(optarg);
+                break;
+            case 'x':
+                opt.speed = atoi(optarg);
+                break;
+            case 't':
+                opt.period_s = atoi(optarg);
+                break;
+            case 'b':
+                opt.batch = atoi(optarg);
+                break;
+            case 'f':
+                if (strcmp(optarg, "batch") == 0) {
+                    opt.format = FORMAT_BATCH;
+                } else if (strcmp(optarg, "text") == 0) {
+                    opt.format = FORMAT_TEXT;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'q':
+                opt.qos = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (opt.speed < 1 || opt.period_s < 1 || opt.batch < 1 ||
+        opt.batch > MAX_BATCH || opt.qos < 0 || opt.qos > 1) {
+        usage(argv[0]);
+    }
+
+    mosquitto_lib_init();
+    srand(getpid());
+    char id[32];
+    snprintf(id, sizeof(id), "fleet_sim-%d-monitor", getpid());
+    monitor = new_client(id, opt.username);
+    mosquitto_subscribe_callback_set(monitor, subscribe_cb);
+    mosquitto_message_callback_set(monitor, message_cb);
+
+    for (char* size = strtok(sizes, ","); size; size = strtok(NULL, ",")) {
+        int count = atoi(size);
+        if (count < band_count || count < 1) {
+            fprintf(stderr, "fleet sizes must grow\n");
+            return 2;
+        }
+        run_fleet(count);
+    }
+
+    for (int i = 0; i < band_count; i++) {
+        mosquitto_disconnect(bands[i].mosq);
+        mosquitto_destroy(bands[i].mosq);
+    }
+    mosquitto_disconnect(monitor);
+    mosquitto_destroy(monitor);
+    mosquitto_lib_cleanup();
+    free(bands);
+    free(run.latency);
+    return 0;
+}
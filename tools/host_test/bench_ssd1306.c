@@ -0,0 +1,123 @@
+/**
+ * @file bench_ssd1306.c
+ * @brief render time of the SSD1306 screens and text path on the host
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./bench_ssd1306 [rounds]
+ *
+ * Times the render into the back buffer only, no frame is submitted or
+ * pushed. Every case runs rounds times, REPEATS times over, and the fastest
+ * repeat is reported, which is the least disturbed by the host. Host
+ * numbers compare renderers with each other, they are not ESP32 times;
+ * SSD1306_benchmark() measures those on the band.
+ *
+ * Then it pushes a full frame in every transfer mode to the emulated panel
+ * and reports what went over the bus, the part of a frame's latency that
+ * does not depend on the host.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_crc.h"
+#include "host.h"
+#include "panel.h"
+
+// the renderers are static
+#include "../../components/SSD1306/SSD1306.c"
+
+#define REPEATS (5)
+
+static int64_t now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint32_t counter = 0;
+
+// switching screens re-renders every widget
+static void main_full() {
+    screen = screen_none;
+    render_main_menu(88888, 36.5, 1);
+}
+
+static void hr_full() {
+    screen = screen_none;
+    render_hr(1, 188, 1);
+}
+
+// one value changes, only its widget is re-rendered
+static void main_step() {
+    render_main_menu(10000 + counter++ % 80000, 36.5, 1);
+}
+
+static void main_same() {
+    render_main_menu(88888, 36.5, 1);
+}
+
+static void text_5_digits() {
+    SSD1306_text(&font_3_12, 5, 0, "88888");
+}
+
+static void text_clipped() {
+    SSD1306_text(&font_3_12, 5, 100, "88888");
+}
+
+static void blit_icon() {
+    SSD1306_blit(3, 24, font_hr_3_24, 3, 32);
+}
+
+static const struct {
+    const char* name;
+    void (*run)();
+} cases[] = {
+    {"main menu, full", main_full},
+    {"main menu, step changed", main_step},
+    {"main menu, unchanged", main_same},
+    {"hr, full", hr_full},
+    {"text, 5 digits 3_12", text_5_digits},
+    {"text, 5 digits 3_12 clipped", text_clipped},
+    {"blit, 3x24 icon", blit_icon},
+};
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+    if (rounds <= 0) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 2;
+    }
+    panel_reset();
+    SSD1306_init();
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        int64_t best = INT64_MAX;
+        for (int r = 0; r < REPEATS; r++) {
+            int64_t begin = now_ns();
+            for (int i = 0; i < rounds; i++) {
+                cases[c].run();
+            }
+            int64_t spent = now_ns() - begin;
+            if (spent < best) {
+                best = spent;
+            }
+        }
+        printf("%-28s %8.1f ns\n", cases[c].name, (double)best / rounds);
+    }
+    // keep the renders observable
+    printf("buffer crc %08x\n", esp_crc32_le(0, buffer, sizeof(buffer)));
+
+    static const char* name[] = {"chunk", "page", "frame"};
+    for (uint8_t m = SSD1306_MODE_CHUNK; m <= SSD1306_MODE_FRAME; m++) {
+        SSD1306_set_mode(m);
+        gddram_valid = 0;
+        uint32_t writes = panel.writes;
+        uint32_t bytes = panel.bytes;
+        SSD1306_push();
+        printf("full frame, %-5s %u GDDRAM bytes, %u transactions, %u bytes "
+               "on the bus\n",
+               name[m], frame_bytes, panel.writes - writes,
+               panel.bytes - bytes);
+    }
+    return 0;
+}
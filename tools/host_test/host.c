@@ -0,0 +1,70 @@
+/**
+ * @file host.c
+ * @brief the host side of the stubs in stub/
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "host.h"
+#include "esp_crc.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+int64_t host_time = 1000000;
+
+int64_t esp_timer_get_time() {
+    return host_time;
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+static int semaphores;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return &semaphores;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+    return &semaphores;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    return pdTRUE;
+}
+
+static int tasks;
+
+BaseType_t xTaskCreate(TaskFunction_t task,
+                       const char* name,
+                       uint32_t stack_size,
+                       void* parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t* handle) {
+    if (handle) {
+        *handle = &tasks;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {}
+
+void vTaskDelay(TickType_t ticks) {
+    host_time += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+TickType_t xTaskGetTickCount() {
+    return host_time / 1000 / portTICK_PERIOD_MS;
+}
@@ -0,0 +1,15 @@
+/**
+ * @file host.h
+ * @brief the host side of the stubs in stub/
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_HOST
+#define NARUKARA_HOST
+
+#include "esp_types.h"
+
+// what esp_timer_get_time() returns, us. Only vTaskDelay() and tests move it
+extern int64_t host_time;
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * @file panel.c
+ * @brief an SSD1306 on the host, see panel.h
+ * @author Narukara
+ * @date 2021.2
+ *
+ * Only what SSD1306.c uses is modelled: horizontal addressing, the column
+ * and page window, content scroll, contrast, charge pump and display on /
+ * off. Anything else is a protocol error, so is GDDRAM written while a
+ * content scroll still runs.
+ */
+#include "panel.h"
+#include <stdio.h>
+#include <string.h>
+#include "NAR_I2C.h"
+#include "host.h"
+
+#define ADDRESS (0x3c)
+#define CO (0x80)  // control byte, one more control byte follows the next
+#define DC (0x40)  // control byte, data instead of commands
+#define FRAME_US (9300)  // one frame at the reset clock, 0xD5 0x80
+
+panel_t panel;
+
+static struct {
+    uint8_t col_begin, col_end, page_begin, page_end;
+    uint8_t col, page;
+    uint8_t command;  // waiting for its arguments, 0 - none
+    uint8_t args[8];
+    uint8_t argc;
+    int64_t scroll_at;  // host_time of the last content scroll
+} state;
+
+void panel_reset() {
+    memset(&panel, 0, sizeof(panel));
+    memset(&state, 0, sizeof(state));
+    // power up content is random
+    for (int i = 0; i < 1024; i++) {
+        panel.gddram[i] = i * 37 + 11;
+    }
+    state.col_end = 127;
+    state.page_end = 7;
+    state.scroll_at = host_time - FRAME_US;
+    panel.contrast = 0x7F;
+    panel.freq = 100000;
+}
+
+static void fail(const char* error) {
+    if (panel.error == NULL) {
+        panel.error = error;
+    }
+}
+
+static uint8_t arg_count(uint8_t command) {
+    switch (command) {
+        case 0x20:
+        case 0x81:
+        case 0x8D:
+            return 1;
+        case 0x21:
+        case 0x22:
+            return 2;
+        case 0x2D:
+            return 7;
+        case 0xAE:
+        case 0xAF:
+            return 0;
+        default:
+            fail("unknown command");
+            return 0;
+    }
+}
+
+/**
+ * @brief 0x2D, every row of the pages moves one column left, the leftmost
+ * column wraps around to the right
+ */
+static void scroll_left(uint8_t first,
+                        uint8_t last,
+                        uint8_t begin,
+                        uint8_t end) {
+    if (first > last || last > 7 || begin >= end || end > 127) {
+        fail("bad content scroll");
+        return;
+    }
+    for (uint8_t page = first; page <= last; page++) {
+        uint8_t* line = panel.gddram + (page << 7);
+        uint8_t out = line[begin];
+        memmove(line + begin, line + begin + 1, end - begin);
+        line[end] = out;
+    }
+}
+
+static void execute(uint8_t command, const uint8_t* args) {
+    switch (command) {
+        case 0x20:
+            if (args[0] != 0x00) {
+                fail("only horizontal addressing is modelled");
+            }
+            break;
+        case 0x21:
+            if (args[0] > args[1] || args[1] > 127) {
+                fail("bad column window");
+            }
+            state.col = state.col_begin = args[0];
+            state.col_end = args[1];
+            break;
+        case 0x22:
+            if (args[0] > args[1] || args[1] > 7) {
+                fail("bad page window");
+            }
+            state.page = state.page_begin = args[0];
+            state.page_end = args[1];
+            break;
+        case 0x2D:
+            scroll_left(args[1], args[3], args[5], args[6]);
+            state.scroll_at = host_time;
+            break;
+        case 0x81:
+            panel.contrast = args[0];
+            break;
+        case 0x8D:
+            panel.pump = args[0] == 0x14;
+            break;
+        case 0xAE:
+        case 0xAF:
+            panel.on = command == 0xAF;
+            break;
+    }
+}
+
+static void command_byte(uint8_t byte) {
+    if (state.command == 0) {
+        state.command = byte;
+        state.argc = 0;
+    } else {
+        state.args[state.argc++] = byte;
+    }
+    if (state.argc == arg_count(state.command)) {
+        execute(state.command, state.args);
+        state.command = 0;
+    }
+}
+
+static void data_byte(uint8_t byte) {
+    if (state.command) {
+        fail("data before the command got its arguments");
+    }
+    if (host_time - state.scroll_at < FRAME_US) {
+        fail("GDDRAM written during a content scroll");
+    }
+    panel.gddram[(state.page << 7) + state.col] = byte;
+    panel.data++;
+    if (state.col++ == state.col_end) {
+        state.col = state.col_begin;
+        if (state.page++ == state.page_end) {
+            state.page = state.page_begin;
+        }
+    }
+}
+
+/**
+ * @brief one I2C write transaction, control byte reg_addr first
+ */
+esp_err_t i2c_write(uint8_t slave_addr,
+                    uint8_t reg_addr,
+                    size_t size,
+                    uint8_t* data) {
+    if (slave_addr != ADDRESS) {
+        return ESP_FAIL;
+    }
+    panel.writes++;
+    panel.bytes += 2 + size;
+    uint8_t control = reg_addr;
+    size_t i = 0;
+    while (i < size) {
+        if (control & DC) {
+            data_byte(data[i++]);
+        } else {
+            command_byte(data[i++]);
+        }
+        if (control & CO) {
+            // a control byte precedes every byte until Co is 0
+            if (i == size) {
+                break;
+            }
+            control = data[i++];
+            if (i == size) {
+                fail("control byte at the end");
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_freq(uint32_t freq) {
+    panel.freq = freq;
+    return ESP_OK;
+}
+
+/**
+ * @brief write GDDRAM as a plain PBM image, the format SSD1306_set_dump()
+ * logs
+ */
+void panel_save(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "P1\n128 64\n");
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 128; x++) {
+            uint8_t lit = panel.gddram[((y >> 3) << 7) + x] & (1 << (y & 7));
+            fputc(lit ? '1' : '0', f);
+        }
+        fputc('\n', f);
+    }
+    fclose(f);
+}
+
+/**
+ * @return pixels that differ from the PBM image at path
+ * | -1 - can't read it
+ */
+int panel_compare(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    int width, height;
+    if (fscanf(f, "P1 %d %d", &width, &height) != 2 || width != 128 ||
+        height != 64) {
+        fclose(f);
+        return -1;
+    }
+    int diff = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 128; x++) {
+            int c;
+            do {
+                c = fgetc(f);
+            } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+            if (c != '0' && c != '1') {
+                fclose(f);
+                return -1;
+            }
+            uint8_t lit = panel.gddram[((y >> 3) << 7) + x] & (1 << (y & 7));
+            diff += (c == '1') != (lit != 0);
+        }
+    }
+    fclose(f);
+    return diff;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file panel.h
+ * @brief an SSD1306 on the host. It takes the place of NAR_I2C, decodes the
+ * command stream the driver writes and keeps its own GDDRAM, so tests see
+ * what the real panel would show.
+ * @author Narukara
+ * @date 2021.2
+ */
+#ifndef NARUKARA_PANEL
+#define NARUKARA_PANEL
+
+#include "esp_types.h"
+
+typedef struct {
+    uint8_t gddram[1024];
+    uint8_t on;         // 0xAF, display on
+    uint8_t pump;       // 0x8D, charge pump on
+    uint8_t contrast;   // 0x81
+    uint32_t freq;      // as set by i2c_set_freq(), Hz
+    uint32_t writes;    // i2c_write() calls to the panel
+    uint32_t bytes;     // on the bus, address byte included
+    uint32_t data;      // GDDRAM bytes written
+    const char* error;  // first protocol error, NULL - none
+} panel_t;
+
+extern panel_t panel;
+
+void panel_reset();
+
+void panel_save(const char* path);
+
+int panel_compare(const char* path);
+
+#endif
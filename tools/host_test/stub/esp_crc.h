@@ -0,0 +1,12 @@
+/**
+ * @file esp_crc.h
+ * @brief host stand-in
+ */
+#ifndef NARUKARA_HOST_ESP_CRC
+#define NARUKARA_HOST_ESP_CRC
+
+#include "esp_types.h"
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#endif
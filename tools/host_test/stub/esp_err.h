@@ -0,0 +1,19 @@
+/**
+ * @file esp_err.h
+ * @brief host stand-in, the error codes the band's code uses
+ */
+#ifndef NARUKARA_HOST_ESP_ERR
+#define NARUKARA_HOST_ESP_ERR
+
+#include "esp_types.h"
+
+typedef int esp_err_t;
+
+#define ESP_OK (0)
+#define ESP_FAIL (-1)
+#define ESP_ERR_NO_MEM (0x101)
+#define ESP_ERR_INVALID_ARG (0x102)
+#define ESP_ERR_INVALID_STATE (0x103)
+#define ESP_ERR_TIMEOUT (0x107)
+
+#endif
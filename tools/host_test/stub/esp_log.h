@@ -0,0 +1,22 @@
+/**
+ * @file esp_log.h
+ * @brief host stand-in, warnings and errors go to stderr, the rest is only
+ * type checked
+ */
+#ifndef NARUKARA_HOST_ESP_LOG
+#define NARUKARA_HOST_ESP_LOG
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) \
+    fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) \
+    fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)               \
+    do {                                         \
+        if (0)                                   \
+            printf(format, ##__VA_ARGS__);       \
+    } while (0)
+#define ESP_LOGD ESP_LOGI
+
+#endif
@@ -0,0 +1,12 @@
+/**
+ * @file esp_timer.h
+ * @brief host stand-in, the time is host_time, see host.h
+ */
+#ifndef NARUKARA_HOST_ESP_TIMER
+#define NARUKARA_HOST_ESP_TIMER
+
+#include "esp_types.h"
+
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,13 @@
+/**
+ * @file esp_types.h
+ * @brief host stand-in, only the integer types the drivers use
+ */
+#ifndef NARUKARA_HOST_ESP_TYPES
+#define NARUKARA_HOST_ESP_TYPES
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file FreeRTOS.h
+ * @brief host stand-in. There is one thread, critical sections are no-ops
+ * and a tick is 10 ms like CONFIG_FREERTOS_HZ=100 on the band.
+ */
+#ifndef NARUKARA_HOST_FREERTOS
+#define NARUKARA_HOST_FREERTOS
+
+#include "esp_types.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE (1)
+#define pdFALSE (0)
+#define pdPASS (1)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS (10)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define tskIDLE_PRIORITY (0)
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif
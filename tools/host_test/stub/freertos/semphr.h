@@ -0,0 +1,17 @@
+/**
+ * @file semphr.h
+ * @brief host stand-in, a take always succeeds
+ */
+#ifndef NARUKARA_HOST_SEMPHR
+#define NARUKARA_HOST_SEMPHR
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ * @file task.h
+ * @brief host stand-in. Tasks are created but never run, a test calls what
+ * they would; delays move host_time on.
+ */
+#ifndef NARUKARA_HOST_TASK
+#define NARUKARA_HOST_TASK
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+BaseType_t xTaskCreate(TaskFunction_t task,
+                       const char* name,
+                       uint32_t stack_size,
+                       void* parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount();
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file test_motion.c
+ * @brief replay ppg + accelerometer traces through maxim_motion_cancel()
+ * and maxim_heart_rate_saturation(), the way MAX30102_measure_hr() runs them
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./test_motion trace.txt ...
+ *
+ * Every trace with a known hr must come out within HR_TOLERANCE. Traces
+ * with motion the canceller changes must also be worse without it, or it is
+ * not what makes them pass. Traces at rest must pass through the canceller
+ * untouched.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "algorithm.h"
+#include "packed.h"
+#include "trace.h"
+
+#define HR_TOLERANCE (5)
+
+static uint8_t buffer[PACKED_SIZE(TRACE_LENGTH)];
+
+static void load(const trace_t* trace) {
+    for (int i = 0; i < trace->length; i++) {
+        packed_set(buffer, i, trace->ir[i]);
+    }
+}
+
+static int32_t error(const trace_t* trace, int32_t hr, int8_t valid) {
+    int32_t e = hr - trace->hr;
+    return valid ? (e < 0 ? -e : e) : 999;
+}
+
+int main(int argc, char* argv[]) {
+    int failed = 0;
+    static trace_t trace;
+    for (int t = 1; t < argc; t++) {
+        if (trace_load(argv[t], &trace)) {
+            failed++;
+            continue;
+        }
+        int32_t hr, raw_hr, quality, raw_quality;
+        int8_t valid, raw_valid;
+
+        load(&trace);
+        maxim_heart_rate_saturation(buffer, trace.length, &raw_hr, &raw_valid,
+                                    &raw_quality);
+
+        load(&trace);
+        maxim_motion_cancel(buffer, trace.accel, trace.length);
+        uint8_t touched = 0;
+        for (int i = 0; i < trace.length; i++) {
+            touched |= packed_get(buffer, i) != (int32_t)trace.ir[i];
+        }
+        maxim_heart_rate_saturation(buffer, trace.length, &hr, &valid,
+                                    &quality);
+
+        const char* why = NULL;
+        if (trace.hr && error(&trace, hr, valid) > HR_TOLERANCE) {
+            why = "hr off";
+        } else if (trace.motion && trace.hr && touched &&
+                   error(&trace, raw_hr, raw_valid) <= HR_TOLERANCE) {
+            why = "passes without the canceller too";
+        } else if (!trace.motion && touched) {
+            why = "canceller changed a trace at rest";
+        }
+        printf("%-4s %s: want %d, got %d q%d, without canceller %d q%d%s%s\n",
+               why ? "FAIL" : "ok", trace.path, trace.hr, valid ? hr : 0,
+               quality, raw_valid ? raw_hr : 0, raw_quality, why ? ", " : "",
+               why ? why : "");
+        failed += why != NULL;
+    }
+    return failed != 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file test_packed.c
+ * @brief the packed, in place algorithm.c against the unpacked one it
+ * replaced, which must give identical results
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./test_packed trace.txt ...
+ *
+ * algorithm_unpacked.c is algorithm.c as it was before the packed buffers,
+ * with later changes to the filters made to both, built with its functions
+ * renamed to unpacked_*. Every trace, and
+ * RANDOM_RUNS random buffers, go through both; hr, valid, quality and the
+ * motion cancelled samples must all match.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "algorithm.h"
+#include "packed.h"
+#include "trace.h"
+
+#define RANDOM_RUNS (2000)
+
+void unpacked_heart_rate_saturation(uint32_t* ir_buffer,
+                                    int32_t buffer_length,
+                                    int32_t* heart_rate,
+                                    int8_t* hr_valid,
+                                    int32_t* hr_quality);
+
+void unpacked_motion_cancel(uint32_t* pun_ir_buffer,
+                            int8_t (*pach_ref)[3],
+                            int32_t n_buffer_length);
+
+static uint8_t packed[PACKED_SIZE(TRACE_LENGTH)];
+static uint32_t unpacked[TRACE_LENGTH];
+
+/**
+ * @return 0 if both paths agree
+ */
+static int compare(const char* name,
+                   const uint32_t* ir,
+                   int8_t (*accel)[3],
+                   int32_t length) {
+    int32_t hr[2], quality[2];
+    int8_t valid[2];
+
+    for (int i = 0; i < length; i++) {
+        packed_set(packed, i, ir[i]);
+    }
+    memcpy(unpacked, ir, length * sizeof(uint32_t));
+    if (accel) {
+        maxim_motion_cancel(packed, accel, length);
+        unpacked_motion_cancel(unpacked, accel, length);
+        for (int i = 0; i < length; i++) {
+            if (packed_get(packed, i) != (int32_t)unpacked[i]) {
+                printf("FAIL %s: motion cancel differs at %d, %d vs %u\n",
+                       name, i, packed_get(packed, i), unpacked[i]);
+                return 1;
+            }
+        }
+    }
+    maxim_heart_rate_saturation(packed, length, &hr[0], &valid[0],
+                                &quality[0]);
+    unpacked_heart_rate_saturation(unpacked, length, &hr[1], &valid[1],
+                                   &quality[1]);
+    if (hr[0] != hr[1] || valid[0] != valid[1] || quality[0] != quality[1]) {
+        printf("FAIL %s: %d %d q%d vs unpacked %d %d q%d\n", name, hr[0],
+               valid[0], quality[0], hr[1], valid[1], quality[1]);
+        return 1;
+    }
+    return 0;
+}
+
+// fixed generator, runs must not depend on the libc
+static uint32_t seed = 1;
+
+static uint32_t next() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+/**
+ * @brief an 18-bit buffer with a random level, swing and rate, sometimes
+ * clipped at either end of the adc range
+ */
+static void random_run(uint32_t* ir, int8_t (*accel)[3], int32_t length) {
+    int32_t dc = next() % 0x40000;
+    int32_t swing = next() % 4096;
+    int32_t period = 30 + next() % 100;
+    int32_t noise = 1 + next() % 64;
+    int32_t motion = next() % 4;
+    for (int i = 0; i < length; i++) {
+        int32_t phase = i % period;
+        int32_t v = dc + swing * (phase < period / 4 ? -1 : 1) +
+                    (int32_t)(next() % noise) - noise / 2;
+        ir[i] = v < 0 ? 0 : (v > 0x3FFFF ? 0x3FFFF : v);
+        for (int a = 0; a < 3; a++) {
+            accel[i][a] = motion ? (int8_t)(next() % (motion * 40)) : 0;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int failed = 0;
+    static trace_t trace;
+    for (int t = 1; t < argc; t++) {
+        if (trace_load(argv[t], &trace)) {
+            failed++;
+            continue;
+        }
+        failed += compare(trace.path, trace.ir, NULL, trace.length);
+        failed += compare(trace.path, trace.ir, trace.accel, trace.length);
+    }
+
+    static uint32_t ir[TRACE_LENGTH];
+    static int8_t accel[TRACE_LENGTH][3];
+    for (int r = 0; r < RANDOM_RUNS; r++) {
+        char name[32];
+        snprintf(name, sizeof(name), "random run %d", r);
+        // short buffers too, down to the rejected ones
+        int32_t length = r % 4 ? TRACE_LENGTH : 8 + next() % TRACE_LENGTH;
+        random_run(ir, accel, length);
+        failed += compare(name, ir, r % 2 ? accel : NULL, length);
+    }
+    printf("%s %d traces, %d random runs, %d failed\n", failed ? "FAIL" : "ok",
+           argc - 1, RANDOM_RUNS, failed);
+    return failed != 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file test_ssd1306.c
+ * @brief SSD1306.c on the host against golden frames
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./test_ssd1306 [-w] chunk|page|frame golden_dir
+ *
+ * Renders every screen through the public SSD1306_display_* calls, pushes
+ * it the way SSD1306_task would in the given mode, and compares what the
+ * emulated panel shows with golden_dir/<step>.pbm. A differing frame is
+ * written next to the golden one as <step>.fail.pbm. -w rewrites the golden
+ * frames instead, look at them before checking them in.
+ *
+ * The driver's own copy of GDDRAM must match the panel after every push, it
+ * is what later pushes are diffed against.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "host.h"
+#include "panel.h"
+
+// the task loop and push are static, drive them directly
+#include "../../components/SSD1306/SSD1306.c"
+
+#define MINUTE_US (60000000LL)
+
+static const char* dir;
+static uint8_t write_golden = 0;
+static int failed = 0;
+
+/**
+ * @brief one round of SSD1306_task, without the wait for frame_ready
+ */
+static void task_step() {
+    SSD1306_power_step();
+    if (power != power_off && pending) {
+        SSD1306_limit();
+        SSD1306_push();
+    }
+}
+
+static const char* name_of(SSD1306_mode_t m) {
+    static const char* names[] = {"chunk", "page", "frame"};
+    return names[m];
+}
+
+static void check(const char* step, uint16_t min_bytes, uint16_t max_bytes) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.pbm", dir, step);
+    const char* why = NULL;
+    int diff = 0;
+    if (panel.error) {
+        why = panel.error;
+    } else if (status != running) {
+        why = "driver fused";
+    } else if (memcmp(gddram, panel.gddram, sizeof(gddram))) {
+        why = "driver lost track of GDDRAM";
+    } else if (frame_bytes < min_bytes || frame_bytes > max_bytes) {
+        why = "unexpected frame size";
+    } else if (write_golden) {
+        panel_save(path);
+    } else if ((diff = panel_compare(path))) {
+        why = diff < 0 ? "no golden frame" : "differs from golden frame";
+        snprintf(path, sizeof(path), "%s/%s.fail.pbm", dir, step);
+        panel_save(path);
+    }
+    printf("%-4s %s %s: %u bytes, %u transactions", why ? "FAIL" : "ok",
+           name_of(mode), step, frame_bytes, frame_transactions);
+    if (why) {
+        printf(", %s", why);
+        if (diff > 0) {
+            printf(", %d pixels", diff);
+        }
+    }
+    printf("\n");
+    failed += why != NULL;
+}
+
+/**
+ * @brief byte bound of a step, frame mode sends whole pages first..last
+ * @param[in] bytes the changed runs, in chunk and page mode
+ * @param[in] pages pages spanned, in frame mode
+ */
+static uint16_t at_most(uint16_t bytes, uint8_t pages) {
+    return mode == SSD1306_MODE_FRAME ? pages << 7 : bytes;
+}
+
+// one font_3_12 digit, 12 columns of 3 pages
+#define GLYPH (36)
+
+/**
+ * @brief feed a 72 bpm pulse into NAR_BUS and plot it for a full screen
+ */
+static void plot_wave() {
+    static const int8_t shape[] = {0,   -20, -60, -90, -100, -85, -60, -45,
+                                   -40, -42, -35, -25, -15,  -8,  -3,  0};
+    for (int i = 0; i < 128; i++) {
+        // 4 samples per WAVE_PERIOD_MS step
+        for (int s = 0; s < 4; s++) {
+            host_time += 10000;
+            int n = (i * 4 + s) * 16 / 83 % 16;
+            NAR_BUS_push(NAR_BUS_PPG, host_time,
+                         (int32_t[]){120000 + shape[n] * 8, 0, 0});
+        }
+        SSD1306_wave_step();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int a = 1;
+    if (a < argc && !strcmp(argv[a], "-w")) {
+        write_golden = 1;
+        a++;
+    }
+    if (argc - a != 2) {
+        fprintf(stderr, "usage: %s [-w] chunk|page|frame golden_dir\n",
+                argv[0]);
+        return 2;
+    }
+    SSD1306_mode_t m = SSD1306_MODE_PAGE;
+    if (!strcmp(argv[a], "chunk")) {
+        m = SSD1306_MODE_CHUNK;
+    } else if (!strcmp(argv[a], "frame")) {
+        m = SSD1306_MODE_FRAME;
+    }
+    dir = argv[a + 1];
+
+    panel_reset();
+    SSD1306_init();
+    SSD1306_set_mode(m);
+    host_time = 83 * MINUTE_US;
+    SSD1306_wake();
+    SSD1306_display_main_menu(12345, 36.5, 1);
+    task_step();
+    if (!panel.on || !panel.pump || panel.contrast != CONTRAST_ON) {
+        printf("FAIL %s wake: panel not lit\n", name_of(mode));
+        failed++;
+    }
+    check("main", 1024, 1024);
+
+    // a step digit, a temperature digit and the wifi icon
+    SSD1306_display_main_menu(12346, 36.6, 0);
+    task_step();
+    check("main_update", 1, at_most(3 * GLYPH, 8));
+
+    SSD1306_display_main_menu(12346, 36.6, 0);
+    task_step();
+    check("main_update", 0, 0);
+
+    SSD1306_display_main_menu(12347, 36.6, 0);
+    task_step();
+    check("main_step", 1, at_most(GLYPH, 3));
+
+    // every step and temperature digit
+    SSD1306_display_main_menu(100000, 9.94, 0);
+    task_step();
+    check("main_max", 1, at_most(10 * GLYPH, 3));
+
+    // new screen, the body below the header and the wifi icon
+    SSD1306_display_hr(1, 72, 1);
+    task_step();
+    check("hr_72", 1, at_most(600, 8));
+
+    SSD1306_display_hr(2, 0, 1);
+    task_step();
+    check("hr_fail", 1, 512);
+
+    SSD1306_display_hr(0, 0, 1);
+    task_step();
+    plot_wave();
+    check("wave", 0, 1024);
+
+    // frames are held while the panel is off, then go out at the next wake
+    host_time += OFF_AFTER_US;
+    task_step();
+    SSD1306_display_main_menu(12347, 36.6, 1);
+    task_step();
+    if (panel.on || panel.pump) {
+        printf("FAIL %s off: panel still lit\n", name_of(mode));
+        failed++;
+    }
+    SSD1306_wake();
+    task_step();
+    check("main_after_off", 1, 1024);
+
+    return failed != 0;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file trace.c
+ * @brief ppg + accelerometer traces for host tests
+ * @author Narukara
+ * @date 2021.2
+ */
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @return 0 on success
+ */
+int trace_load(const char* path, trace_t* trace) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    memset(trace, 0, sizeof(*trace));
+    trace->path = path;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        int ir, ax, ay, az;
+        if (line[0] == '#') {
+            sscanf(line, "# hr %d", &trace->hr);
+            if (sscanf(line, "# motion %d", &ax) == 1) {
+                trace->motion = ax;
+            }
+            continue;
+        }
+        if (sscanf(line, "%d %d %d %d", &ir, &ax, &ay, &az) != 4) {
+            continue;
+        }
+        if (trace->length == TRACE_LENGTH) {
+            break;
+        }
+        trace->ir[trace->length] = ir;
+        trace->accel[trace->length][0] = ax;
+        trace->accel[trace->length][1] = ay;
+        trace->accel[trace->length][2] = az;
+        trace->length++;
+    }
+    fclose(f);
+    if (trace->length != TRACE_LENGTH) {
+        fprintf(stderr, "%s: %d samples, want %d\n", path, trace->length,
+                TRACE_LENGTH);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file trace.h
+ * @brief ppg + accelerometer traces for host tests
+ * @author Narukara
+ * @date 2021.2
+ *
+ * One text file per trace, '#' lines are comments except the keys below.
+ * # hr 72        expected heart rate, 0 - unknown
+ * # motion 1     the wearer moves, 0 - at rest
+ * ir ax ay az    one row per 10 ms sample, ir as read from the hr sensor,
+ *                accelerometer at 64 LSB/g like MAX30102_accel_ref() makes it
+ */
+#ifndef NARUKARA_TRACE
+#define NARUKARA_TRACE
+
+#include <stdint.h>
+
+#define TRACE_LENGTH (500)
+
+typedef struct {
+    const char* path;
+    int32_t hr;
+    uint8_t motion;
+    int32_t length;
+    uint32_t ir[TRACE_LENGTH];
+    int8_t accel[TRACE_LENGTH][3];
+} trace_t;
+
+int trace_load(const char* path, trace_t* trace);
+
+#endif
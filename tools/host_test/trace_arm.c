@@ -0,0 +1,125 @@
+/**
+ * @file trace_arm.c
+ * @brief ppg + accelerometer traces from a swinging arm, in the trace.h
+ * format
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./trace_arm hr swing_deg stride_hz arm_m seed > trace.txt
+ *
+ * trace_gen.c adds the artifact as a delayed linear mix of the
+ * acceleration, which is the model maxim_motion_cancel() assumes, so a pass
+ * there says little. Here the arm is a pendulum from the shoulder and both
+ * sides are derived from its motion instead:
+ * - the accelerometer sees the tangential and centripetal acceleration,
+ *   gravity turning with the arm and the heel strikes, quantized to 64 LSB/g
+ * - the ir signal sees the veins drain as the wrist rises, through the
+ *   lag of the tissue, and the band pressing into the skin, which saturates
+ * Neither is a linear function of the reference the canceller gets.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+#define FS (100)
+#define G (9.81)
+#define DC (120000)
+#define AC (700)           // pulse amplitude, about 0.6% perfusion
+#define NOISE (15)         // sensor noise, sigma
+#define POOLING (4500)     // ir counts per m the wrist is raised, settled
+#define POOLING_TAU (0.25) // s, venous filling
+#define PRESS (450)        // ir counts, band fully pressed in
+#define PRESS_G (1.5)      // tangential g that presses it 3/4 in
+#define PRESS_TAU (0.04)   // s, skin recoil
+#define STRIKE_G (0.8)     // peak of a heel strike
+#define LSB_PER_G (64)
+
+// fixed generator, the traces must not depend on the libc
+static uint32_t seed = 1;
+
+static double uniform() {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.0;
+}
+
+static double gaussian() {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/**
+ * @brief blood volume over one beat, a steep rise and a slower, skewed fall
+ */
+static double pulse(double phase) {
+    double s = phase < 0.12 ? phase / 0.12 : exp(-(phase - 0.12) / 0.18);
+    return phase < 0.12 ? s * s * (3 - 2 * s) : s;
+}
+
+/**
+ * @return vertical body acceleration in g, a damped ring after every step
+ */
+static double strike(double t, double stride_hz) {
+    double since = fmod(t, 0.5 / stride_hz);
+    return STRIKE_G * exp(-since / 0.03) * sin(2 * M_PI * 14 * since);
+}
+
+static int8_t to_lsb(double g) {
+    double v = round(g * LSB_PER_G);
+    return v > 127 ? 127 : (v < -128 ? -128 : (int8_t)v);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 6) {
+        fprintf(stderr, "usage: %s hr swing_deg stride_hz arm_m seed\n",
+                argv[0]);
+        return 2;
+    }
+    double hr = atof(argv[1]);
+    double amp = atof(argv[2]) * M_PI / 180;
+    double w = 2 * M_PI * atof(argv[3]);
+    double len = atof(argv[4]);
+    seed = atoi(argv[5]);
+
+    printf("# trace_arm %s %s %s %s %s\n", argv[1], argv[2], argv[3], argv[4],
+           argv[5]);
+    printf("# hr %d\n", (int)hr);
+    printf("# motion %d\n", amp > 0);
+    double phase = uniform();
+    double period = 60.0 / hr;
+    double offset = 2 * M_PI * uniform();
+    double drained = 0, pressed = 0;
+    for (int i = 0; i < TRACE_LENGTH; i++) {
+        double t = (double)i / FS;
+        phase += 1.0 / FS / period;
+        if (phase >= 1) {
+            phase -= 1;
+            // beat to beat variation, 2%
+            period = 60.0 / hr * (1 + 0.02 * gaussian());
+        }
+        // the swing is not a pure sine, the arm is pulled back harder
+        double a = w * t + offset;
+        double th = amp * (sin(a) + 0.15 * sin(2 * a + 0.7));
+        double dth = amp * w * (cos(a) + 0.3 * cos(2 * a + 0.7));
+        double ddth = -amp * w * w * (sin(a) + 0.6 * sin(2 * a + 0.7));
+        double v = strike(t, w / (2 * M_PI));
+
+        // specific force on the wrist, x along the swing, y up the arm
+        double fx = (len * ddth + G * sin(th)) / G + v * sin(th);
+        double fy = (len * dth * dth + G * cos(th)) / G + v * cos(th);
+        double fz = 0.05 * sin(a / 2);
+
+        // the wrist raised above its lowest point drains the veins, lagging
+        double rise = len * (1 - cos(th));
+        drained += (POOLING * rise - drained) / (POOLING_TAU * FS);
+        double push = PRESS * tanh(len * ddth / G / PRESS_G);
+        pressed += (push - pressed) / (PRESS_TAU * FS);
+
+        double ir = DC - AC * pulse(phase) + drained - pressed +
+                    NOISE * gaussian();
+        printf("%d %d %d %d\n", (int)ir, to_lsb(fx), to_lsb(fy), to_lsb(fz));
+    }
+    return 0;
+}
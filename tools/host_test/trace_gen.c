@@ -0,0 +1,108 @@
+/**
+ * @file trace_gen.c
+ * @brief synthetic ppg + accelerometer traces in the trace.h format
+ * @author Narukara
+ * @date 2021.2
+ *
+ * ./trace_gen hr motion_g cadence_hz seed > trace.txt
+ *
+ * A pulse with a fast upstroke and a dicrotic bump, slight beat to beat
+ * variation, respiration wander and sensor noise. With motion_g > 0 the
+ * wrist swings at cadence_hz, and the ir signal picks up a delayed linear
+ * mix of the acceleration, the artifact maxim_motion_cancel() models.
+ * Only for the checked in traces, recordings from the stream topic use the
+ * same format.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+#define FS (100)
+#define DC (120000)
+#define AC (700)           // pulse amplitude, about 0.6% perfusion
+#define WANDER (150)       // respiration, 0.25 Hz
+#define NOISE (15)         // sensor noise, sigma
+#define ARTIFACT (2500)    // ir counts per g of wrist acceleration
+#define LSB_PER_G (64)
+
+// fixed generator, the traces must not depend on the libc
+static uint32_t seed = 1;
+
+static double uniform() {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.0;
+}
+
+static double gaussian() {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/**
+ * @brief blood volume over one beat, fast upstroke, slow runoff with a
+ * dicrotic bump
+ */
+static double pulse(double phase) {
+    double s = (phase - 0.15) / (phase < 0.15 ? 0.05 : 0.2);
+    double d = (phase - 0.5) / 0.08;
+    return exp(-s * s) + 0.15 * exp(-d * d);
+}
+
+/**
+ * @return acceleration of one axis in g, gravity excluded
+ */
+static double swing(int axis, double g, double hz, double t) {
+    double w = 2 * M_PI * hz * t;
+    switch (axis) {
+        case 0:
+            return g * sin(w);
+        case 1:
+            return g * (0.6 * sin(w + 1.0) + 0.3 * sin(2 * w));
+        default:
+            return g * 0.4 * sin(w + 2.0);
+    }
+}
+
+static int8_t to_lsb(double g) {
+    double v = round(g * LSB_PER_G);
+    return v > 127 ? 127 : (v < -128 ? -128 : (int8_t)v);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "usage: %s hr motion_g cadence_hz seed\n", argv[0]);
+        return 2;
+    }
+    double hr = atof(argv[1]);
+    double g = atof(argv[2]);
+    double hz = atof(argv[3]);
+    seed = atoi(argv[4]);
+
+    printf("# trace_gen %s %s %s %s\n", argv[1], argv[2], argv[3], argv[4]);
+    printf("# hr %d\n", (int)hr);
+    printf("# motion %d\n", g > 0);
+    double phase = uniform();
+    double period = 60.0 / hr;
+    for (int i = 0; i < TRACE_LENGTH; i++) {
+        double t = (double)i / FS;
+        phase += 1.0 / FS / period;
+        if (phase >= 1) {
+            phase -= 1;
+            // beat to beat variation, 2%
+            period = 60.0 / hr * (1 + 0.02 * gaussian());
+        }
+        double ir = DC - AC * pulse(phase) +
+                    WANDER * sin(2 * M_PI * 0.25 * t) + NOISE * gaussian();
+        if (g > 0) {
+            // the wrist moves first, the blood follows a little later
+            ir += ARTIFACT * (0.8 * swing(0, g, hz, t - 0.03) +
+                              0.5 * swing(1, g, hz, t - 0.05));
+        }
+        printf("%d %d %d %d\n", (int)ir, to_lsb(swing(0, g, hz, t)),
+               to_lsb(swing(1, g, hz, t)), to_lsb(1 + swing(2, g, hz, t)));
+    }
+    return 0;
+}